@@ -0,0 +1,57 @@
+#ifndef MICTCP_CC_H
+#define MICTCP_CC_H
+
+/*
+ * Congestion control of a windowed sender. The congestion window is counted
+ * in PDUs, like the send window it limits, and lives in the connection. An
+ * algorithm is a set of callbacks on the events of the sender: new data
+ * acknowledged (with an RTT sample when there is one), loss detected by
+ * duplicate acks (fast retransmit) and retransmission timeout. Available
+ * algorithms:
+ *   reno   slow start then additive increase, multiplicative decrease (RFC 5681):
+ *          a fast retransmit halves the window, a timeout brings it back to one PDU
+ *   vegas  delay-based: keeps between CC_VEGAS_ALPHA and CC_VEGAS_BETA PDUs
+ *          queued along the path, from the RTT above the lowest one seen
+ *   none   no limit but flow control
+ * Every change of the window can be appended to a trace file (CSV).
+ */
+
+#define CC_DEFAULT "reno"
+#define CC_INITIAL_WINDOW 4     /* PDUs, RFC 3390 for segments of about 1 KB */
+#define CC_MIN_SSTHRESH 2
+#define CC_MAX_WINDOW 65535
+#define CC_VEGAS_ALPHA 2
+#define CC_VEGAS_BETA 4
+#define CC_VEGAS_GAMMA 1        /* slow start ends once this many PDUs are queued */
+
+typedef struct mic_tcp_cc mic_tcp_cc;
+
+typedef struct mic_tcp_cc_ops
+{
+  const char* name;
+  void (*init)(mic_tcp_cc*);
+  void (*on_ack)(mic_tcp_cc*, unsigned int acked, unsigned long rtt_usec);   /* rtt_usec 0: no sample */
+  void (*on_loss)(mic_tcp_cc*, unsigned int in_flight);
+  void (*on_timeout)(mic_tcp_cc*, unsigned int in_flight);
+} mic_tcp_cc_ops;
+
+struct mic_tcp_cc
+{
+  const mic_tcp_cc_ops* ops;
+  int socket;                 /* for the trace */
+  unsigned int cwnd;          /* PDUs that may be in flight */
+  unsigned int ssthresh;      /* slow start below, congestion avoidance above */
+  unsigned int acked;         /* PDUs acknowledged since the last increase (congestion avoidance) or round (vegas) */
+  unsigned long base_rtt;     /* vegas: lowest RTT seen, 0 before the first sample */
+  unsigned long round_rtt;    /* vegas: lowest RTT of the current round, 0 before its first sample */
+};
+
+int cc_init(mic_tcp_cc*, const char* algorithm, int socket);
+void cc_ack(mic_tcp_cc*, unsigned int acked, unsigned long rtt_usec);
+void cc_loss(mic_tcp_cc*, unsigned int in_flight);
+void cc_timeout(mic_tcp_cc*, unsigned int in_flight);
+unsigned int cc_window(mic_tcp_cc*);
+int cc_set_default(const char* algorithm);
+int cc_trace(const char* path);
+
+#endif
@@ -2,20 +2,64 @@
 #define MICTCP_CORE_H
 
 #include <mictcp.h>
+#include <api/mictcp_ring.h>
+#include <api/mictcp_impair.h>
+#include <api/mictcp_sim.h>
+#include <api/mictcp_shm.h>
+#include <api/mictcp_stats.h>
+#include <api/mictcp_log.h>
+#include <api/mictcp_cc.h>
+#include <api/mictcp_timer.h>
 #include <math.h>
 
 /**************************************************************
  * Public core functions, can be used for implementing mictcp *
  **************************************************************/
 
+#define MAX_SOCKETS 256
+#define MAX_BATCH 64
+#define DUPACK_THRESHOLD 3  /* duplicate acks before a fast retransmit, by default */
+#define ACK_DELAY 200       /* µs a receiver may hold the ack of an in-order PDU, by default: below RTO_MIN */
+#define REORDER_HOLD 10000  /* µs a partially reliable receiver waits for a hole before skipping it, by default */
+
 int initialize_components(start_mode sm);
 
 int IP_send(mic_tcp_pdu, mic_tcp_sock_addr);
+void IP_send_begin();
+int IP_send_flush();
 int IP_recv(mic_tcp_pdu*, mic_tcp_sock_addr*, unsigned long timeout);
-int app_buffer_get(mic_tcp_payload);
-void app_buffer_put(mic_tcp_payload);
+int IP_recv_us(mic_tcp_pdu*, mic_tcp_sock_addr*, unsigned long timeout_usec);
+int app_buffer_get(int socket, mic_tcp_payload);
+int app_buffer_put(int socket, mic_tcp_payload, unsigned int timestamp);
+int app_buffer_set_capacity(int socket, unsigned int capacity);
+unsigned int app_buffer_free(int socket);
+unsigned int app_buffer_depth(int socket);
+
+int socket_alloc();
+void socket_free(int socket);
+void set_socket_hook(void (*hook)(int socket));
+int demux_listen(unsigned short local_port, int socket);
+int demux_add(mic_tcp_sock_addr remote, unsigned short local_port, int socket);
+void demux_remove(mic_tcp_sock_addr remote, unsigned short local_port);
+int demux_lookup(mic_tcp_pdu*, mic_tcp_sock_addr*);
 
 void set_loss_rate(unsigned short);
+int set_loss_trace(const char* path);
+void set_impairment(const mic_tcp_impairment*);
+void set_bottleneck(const mic_tcp_bottleneck*);
+void get_impairment_stats(mic_tcp_impair_stats*);
+int set_stats_dump(const char* path, unsigned long interval_msec);
+int set_congestion_control(const char* algorithm);
+int set_cwnd_trace(const char* path);
+void set_sack(int enabled);
+int get_sack();
+void set_dupack_threshold(unsigned short threshold);
+unsigned short get_dupack_threshold();
+void set_ack_delay(unsigned long delay_usec);
+unsigned long get_ack_delay();
+void set_reorder_hold(unsigned long hold_usec);
+unsigned long get_reorder_hold();
+void set_batch_size(unsigned short);
 unsigned long get_now_time_msec();
 unsigned long get_now_time_usec();
 
@@ -28,7 +72,7 @@ unsigned long get_now_time_usec();
 #ifndef API_SC_Port
   #define API_SC_Port 8525
 #endif
-#define API_HD_Size 15
+#define API_HD_Size 21
 
 typedef struct ip_payload
 {
@@ -36,11 +80,13 @@ typedef struct ip_payload
   int size; /* taille des données */
 } ip_payload;
 
-int mic_tcp_core_send(mic_tcp_payload);
-mic_tcp_payload get_full_stream(mic_tcp_pdu);
-mic_tcp_payload get_mic_tcp_data(ip_payload);
+int mic_tcp_core_send(mic_tcp_pdu*, struct sockaddr_in*);
+int IP_send_flush_queue();
 mic_tcp_header get_mic_tcp_header(ip_payload);
 void* listening(void*);
+void* bridging(void*);
+int socket_in_use(int socket);
+int demux_udp_addr(mic_tcp_sock_addr, unsigned short local_port, struct sockaddr_in*);
 void print_header(mic_tcp_pdu);
 
 int min_size(int, int);
@@ -0,0 +1,36 @@
+#ifndef MICTCP_FUTEX_H
+#define MICTCP_FUTEX_H
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * Futex calls of the core's rings. The private pair is for words of this
+ * process (app buffer, logger); the shared pair for words of a segment
+ * mapped by several processes (shared-memory transport). A null timeout
+ * waits until woken.
+ */
+
+static inline void futex_wait(int* word, int value)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void futex_wake(int* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static inline void futex_wait_shared(int* word, int value, const struct timespec* timeout)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static inline void futex_wake_shared(int* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+#endif
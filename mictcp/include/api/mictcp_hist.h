@@ -0,0 +1,30 @@
+#ifndef MICTCP_HIST_H
+#define MICTCP_HIST_H
+
+/*
+ * Latency histogram with log-linear buckets, in the manner of HdrHistogram:
+ * values below 2^HIST_SUB_BITS µs have a bucket each, then every power of
+ * two is cut into 2^(HIST_SUB_BITS-1) buckets of equal width, so a value is
+ * known within 1/2^(HIST_SUB_BITS-1) of itself (3% here). The memory is fixed
+ * (values are counted up to 2^HIST_MAX_BITS µs, larger ones in the last
+ * bucket) and any thread may record without a lock.
+ */
+
+#define HIST_SUB_BITS 5
+#define HIST_MAX_BITS 32    /* about 71 minutes */
+#define HIST_HALF (1 << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_HALF)
+
+typedef struct mic_tcp_hist
+{
+  unsigned long buckets[HIST_BUCKETS];
+  unsigned long count;
+  unsigned long max;
+} mic_tcp_hist;
+
+void hist_reset(mic_tcp_hist*);
+void hist_record(mic_tcp_hist*, unsigned long value);
+unsigned long hist_percentile(mic_tcp_hist*, double percent);
+unsigned long hist_max(mic_tcp_hist*);
+
+#endif
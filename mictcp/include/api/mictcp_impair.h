@@ -0,0 +1,76 @@
+#ifndef MICTCP_IMPAIR_H
+#define MICTCP_IMPAIR_H
+
+#include <netinet/in.h>
+
+/*
+ * Network impairment applied by the core to every datagram it sends:
+ * Gilbert-Elliott burst loss, fixed delay plus jitter, reordering and
+ * duplication, then optionally a bottleneck link (token bucket rate,
+ * finite drop-tail or RED queue, propagation delay), one per direction. Random draws come from a per-thread generator seeded from
+ * the configuration, and delayed datagrams are sent by a delivery thread,
+ * so that the sender never waits for them.
+ * A recorded trace may replace the loss and delay models: each datagram then
+ * takes the next line of the trace, and the same trace and seed give the same
+ * decisions on every run.
+ */
+
+#define IMPAIR_MAX_COPIES 2     /* a datagram and its duplicate */
+#define IMPAIR_MAX_QUEUE 4096   /* datagrams waiting in the delivery thread */
+
+typedef struct mic_tcp_impairment
+{
+  /* Gilbert-Elliott loss, in percent: a uniform loss rate has both states equal */
+  float loss_good;        /* loss rate in the good state */
+  float loss_bad;         /* loss rate in the bad state */
+  float good_to_bad;      /* chance of entering the bad state, per datagram */
+  float bad_to_good;      /* chance of leaving the bad state, per datagram */
+
+  unsigned long delay_usec;   /* fixed one-way delay */
+  unsigned long jitter_usec;  /* uniform extra delay in [0, jitter_usec] */
+  float reorder;          /* percent of datagrams sent without delay, ahead of delayed ones */
+  float duplicate;        /* percent of datagrams sent twice */
+
+  unsigned int seed;      /* same seed and configuration, same draws */
+} mic_tcp_impairment;
+
+typedef struct mic_tcp_bottleneck
+{
+  unsigned long rate_bps;     /* link rate in bit/s, 0 disables the bottleneck */
+  unsigned long burst_bytes;  /* token bucket depth: bytes that may leave back to back */
+  unsigned long queue_bytes;  /* buffer in front of the link */
+  int red;                    /* 1 for RED, 0 for drop-tail */
+  unsigned long red_min;      /* RED: no early drop below this average queue, in bytes */
+  unsigned long red_max;      /* RED: every datagram dropped above this average queue */
+  float red_max_p;            /* RED: drop chance reached at red_max, in percent */
+  unsigned long propagation_usec; /* one-way propagation delay after the link */
+} mic_tcp_bottleneck;
+
+typedef struct mic_tcp_impair_stats
+{
+  unsigned long sent;         /* datagrams handed to the impairment stage */
+  unsigned long lost;
+  unsigned long duplicated;
+  unsigned long delayed;
+  unsigned long reordered;
+  unsigned long replayed;     /* datagrams whose fate came from the trace */
+
+  /* Bottleneck queues, both directions together */
+  unsigned long queue_bytes;      /* current occupancy */
+  unsigned long queue_max_bytes;  /* highest occupancy of one queue */
+  unsigned long queue_drops;      /* drop-tail drops */
+  unsigned long red_drops;        /* RED early drops */
+  unsigned long forwarded;        /* datagrams through the link */
+} mic_tcp_impair_stats;
+
+void impair_set(const mic_tcp_impairment*);
+void impair_get(mic_tcp_impairment*);
+void impair_set_bottleneck(const mic_tcp_bottleneck*);
+int impair_load_trace(const char* path);
+int impair_packet(int size, unsigned long delays[IMPAIR_MAX_COPIES]);
+int impair_schedule(int fd, const void* header, int header_size, const void* data, int data_size,
+                    const struct sockaddr_in* dest, unsigned long delay_usec);
+void impair_stats(mic_tcp_impair_stats*);
+unsigned long impair_random();
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef MICTCP_LOG_H
+#define MICTCP_LOG_H
+
+/*
+ * Leveled logging. A message above LOG_LEVEL (a build flag, see the
+ * Makefile) is removed by the preprocessor, arguments included. The others
+ * are formatted by the calling thread into a slot of a lock-free ring, and
+ * a background thread writes them to the standard output: the protocol never
+ * waits for a terminal or a pipe. Errors and warnings are written at once to
+ * the standard error, the program may not survive them.
+ *
+ * A message is one line, without its '\n'. When the ring is full the message
+ * is dropped and counted; what is left is written when the program exits.
+ */
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_CAPACITY 4096   /* messages, power of two */
+#define LOG_SLOT_SIZE 256   /* longer messages are cut */
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) log_write(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do {} while(0)
+#endif
+
+void log_write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void log_flush();
+
+#endif
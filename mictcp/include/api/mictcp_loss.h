@@ -0,0 +1,25 @@
+#ifndef MICTCP_LOSS_H
+#define MICTCP_LOSS_H
+
+/*
+ * Loss budget: allows at most k losses in any n consecutive messages.
+ * The outcome of the last n messages is kept in a circular bitmap, so both
+ * the decision and the update are O(1).
+ */
+
+#define LOSS_BUDGET_MAX_WINDOW 1024
+
+typedef struct loss_budget
+{
+  unsigned long lost[LOSS_BUDGET_MAX_WINDOW / (8 * sizeof(unsigned long))]; /* 1 bit per message */
+  int window;   /* n: number of consecutive messages considered */
+  int allowed;  /* k: losses allowed within the window */
+  int pos;      /* slot of the oldest outcome, overwritten by the next one */
+  int nb_lost;  /* losses currently in the window */
+} loss_budget;
+
+void loss_budget_init(loss_budget*, unsigned short percent, int window);
+int loss_budget_allows(loss_budget*);
+void loss_budget_record(loss_budget*, int lost);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MICTCP_RING_H
+#define MICTCP_RING_H
+
+/*
+ * Single-producer / single-consumer ring of preallocated message slots.
+ * The producer (the reception thread) and the consumer (mic_tcp_recv) only
+ * synchronize through the head and tail indexes; a futex wakes the consumer
+ * up, and is only touched when the consumer is actually asleep.
+ */
+
+#define RING_DEFAULT_CAPACITY 256
+#define RING_MAX_CAPACITY 65536
+#define RING_SLOT_SIZE 1500
+
+typedef struct ring_slot
+{
+  int size;
+  unsigned int timestamp;   /* carried along with the message, see app_buffer_put */
+  char data[RING_SLOT_SIZE];
+} ring_slot;
+
+typedef struct mic_tcp_ring
+{
+  ring_slot* slots;
+  unsigned int capacity;  /* power of two */
+  unsigned int head;      /* next slot read, written by the consumer only */
+  unsigned int tail;      /* next slot written, written by the producer only */
+  int sleeping;           /* futex word: 1 while the consumer waits */
+} mic_tcp_ring;
+
+int ring_init(mic_tcp_ring*, unsigned int capacity);
+void ring_destroy(mic_tcp_ring*);
+int ring_put(mic_tcp_ring*, const char* data, int size, unsigned int timestamp);
+int ring_get(mic_tcp_ring*, char* data, int max_size, unsigned int* timestamp);
+unsigned int ring_free_slots(mic_tcp_ring*);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MICTCP_RTO_H
+#define MICTCP_RTO_H
+
+/*
+ * Retransmission timeout estimation (RFC 6298) from RTT samples measured
+ * with get_now_time_usec(). All values are in microseconds.
+ */
+
+#define RTO_INITIAL 10000   /* before the first sample: the former fixed 10 ms timer */
+#define RTO_MIN 500
+#define RTO_MAX 1000000
+#define RTO_MAX_BACKOFF 6   /* at most 2^6 times the estimate: enough for the initial timer to pass RTTs up to 640 ms */
+#define RTO_GRANULARITY 100
+#define RTO_MIN_VARIATION 4 /* the variation term is at least SRTT/4 */
+
+typedef struct mic_tcp_rto
+{
+  long srtt;          /* smoothed RTT, -1 until the first sample */
+  long rttvar;        /* RTT variation */
+  unsigned long rto;  /* retransmission timeout from the estimates */
+  int backoff;        /* number of doublings since the last ACK */
+} mic_tcp_rto;
+
+void rto_init(mic_tcp_rto*);
+void rto_ack(mic_tcp_rto*, unsigned long rtt, int retransmitted);
+void rto_backoff(mic_tcp_rto*);
+unsigned long rto_get(mic_tcp_rto*);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef MICTCP_SHM_H
+#define MICTCP_SHM_H
+
+#include <netinet/in.h>
+#include <sys/types.h>
+
+/*
+ * Shared-memory transport between cores of the same host. Each core owns an
+ * inbox, a ring of datagram slots in /dev/shm named after its UDP port, that
+ * any local core may write into: producers claim slots with a compare-and-swap
+ * on the tail (slot sequence numbers as in a bounded MPMC queue), and a
+ * process-shared futex wakes the consumer up only when it actually sleeps.
+ */
+
+#define SHM_RING_CAPACITY 1024      /* slots, power of two */
+#define SHM_SLOT_SIZE 1500          /* a whole datagram, header included */
+#define SHM_NAME "/mictcp-%u"       /* segment of the core bound to this UDP port */
+#define SHM_MAGIC 0x6d696373        /* cleared when the owner closes its inbox */
+
+typedef struct shm_slot
+{
+  unsigned long seq;          /* position the slot is ready for, see mictcp_shm.c */
+  struct sockaddr_in src;     /* where the sender core receives */
+  int size;
+  char data[SHM_SLOT_SIZE];
+} shm_slot;
+
+typedef struct shm_ring
+{
+  unsigned int magic;         /* SHM_MAGIC while the inbox is open */
+  pid_t owner;                /* consumer process, senders check it is alive */
+  unsigned int capacity;
+  int sleeping;               /* futex word: 1 while the consumer waits */
+  unsigned long head __attribute__((aligned(64)));   /* next slot read, by the consumer */
+  unsigned long tail __attribute__((aligned(64)));   /* next slot claimed, by the producers */
+  shm_slot slots[] __attribute__((aligned(64)));
+} shm_ring;
+
+shm_ring* shm_ring_create(unsigned short port);
+shm_ring* shm_ring_attach(unsigned short port);
+void shm_ring_detach(shm_ring*);
+void shm_ring_destroy(shm_ring*, unsigned short port);
+int shm_ring_put(shm_ring*, const struct sockaddr_in* src, const void* header, int header_size,
+                 const void* data, int data_size);
+int shm_ring_get(shm_ring*, struct sockaddr_in* src, void* header, int header_size,
+                 void* data, int data_size, unsigned long timeout_usec, int wait);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MICTCP_SIM_H
+#define MICTCP_SIM_H
+
+#include <mictcp.h>
+
+/*
+ * Discrete-event simulation of the network, replacing the UDP fake IP when
+ * enabled before the first mic_tcp_socket: client and server run in the same
+ * process, datagrams go through the impairment stage then wait in memory
+ * until their delivery date, and get_now_time_usec returns the virtual clock.
+ *
+ * The clock only moves when the client waits: IP_recv on the client side
+ * jumps to the next datagram (or to its timeout), delivering on the way the
+ * datagrams bound to the server to process_received_PDU, in the calling
+ * thread. Whatever runs the server application calls sim_endpoint(SERVER)
+ * so that what it sends goes to the client; a hook given to sim_on_advance
+ * lets it catch up each time before the clock moves. The timers of the core
+ * (mictcp_timer.h) are events of the same clock, run by the same thread.
+ */
+
+#define SIM_EPOCH 1000000UL     /* virtual date of sim_enable, in µs */
+
+typedef struct mic_tcp_sim_stats
+{
+  unsigned long datagrams[2];   /* PDUs handed to the core, by sending end (CLIENT, SERVER) */
+  unsigned long data[2];        /* those of them with a payload */
+} mic_tcp_sim_stats;
+
+void sim_enable();
+int sim_enabled();
+void sim_endpoint(start_mode end);
+void sim_on_advance(void (*hook)());
+unsigned long sim_now();
+void sim_run(unsigned long duration_usec);
+void sim_stats(mic_tcp_sim_stats*);
+
+/* Used by the core */
+void sim_account(const mic_tcp_pdu* pk);
+start_mode sim_side();
+int sim_send(const mic_tcp_pdu* pk, unsigned long delay_usec);
+int sim_recv(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout_usec, int wait);
+int sim_timer(int socket, unsigned long delay_usec, void (*expire)(int socket));
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef MICTCP_STATS_H
+#define MICTCP_STATS_H
+
+#include <mictcp.h>
+#include <api/mictcp_rto.h>
+#include <api/mictcp_hist.h>
+#include <stddef.h>
+
+/*
+ * Per-socket counters returned by mic_tcp_get_stats. The versions update
+ * them as events happen (STATS_ADD), the core resets them when the socket
+ * is allocated, and a background thread may append them to a file at a
+ * fixed interval, one JSON object per socket and per round (plus a last one
+ * when the socket is freed). Two latency histograms per socket give the
+ * percentiles: acknowledgement of a message by the sender, and delivery to
+ * the application by the receiver.
+ */
+
+#define STATS_ADD(socket, field, n) stats_add(socket, offsetof(mic_tcp_stats, field), n)
+#define STATS_DUMP_INTERVAL 1000    /* ms, without MICTCP_STATS_INTERVAL */
+
+void stats_reset(int socket);
+void stats_release(int socket);
+void stats_add(int socket, size_t offset, unsigned long n);
+void stats_rto(int socket, mic_tcp_rto*);
+void stats_ack_latency(int socket, unsigned long usec);
+void stats_delivery_latency(int socket, unsigned long usec);
+int stats_get(int socket, mic_tcp_stats*);
+int stats_dump(const char* path, unsigned long interval_msec);
+
+#endif
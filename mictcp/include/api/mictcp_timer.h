@@ -0,0 +1,15 @@
+#ifndef MICTCP_TIMER_H
+#define MICTCP_TIMER_H
+
+/*
+ * Deferred calls for the versions, one pending per socket: expire(socket)
+ * runs once delay_usec is over, in a thread of the core (the timer thread,
+ * or on the simulated link the thread that moves the clock), with no lock of
+ * the core held. Arming a socket again keeps the earlier date, and a call may
+ * come after its reason is gone: the version checks its own state then, and
+ * arms again if it is still early.
+ */
+
+int timer_arm(int socket, unsigned long delay_usec, void (*expire)(int socket));
+
+#endif
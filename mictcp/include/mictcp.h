@@ -68,6 +68,8 @@ typedef struct mic_tcp_header
   unsigned short dest_port; /* numéro de port de destination */
   unsigned int seq_num; /* numéro de séquence */
   unsigned int ack_num; /* numéro d'acquittement */
+  unsigned int timestamp; /* date de soumission du message par l'application émettrice, en µs (32 bits de poids faible) */
+  unsigned short window; /* nombre de messages que l'émetteur du PDU peut encore recevoir */
   unsigned char syn; /* flag SYN (valeur 1 si activé et 0 si non) */
   unsigned char ack; /* flag ACK (valeur 1 si activé et 0 si non) */
   unsigned char fin; /* flag FIN (valeur 1 si activé et 0 si non) */
@@ -82,6 +84,39 @@ typedef struct mic_tcp_pdu
   mic_tcp_payload payload; /* charge utile du PDU */
 } mic_tcp_pdu;
 
+/*
+ * Compteurs d'un socket, rendus par mic_tcp_get_stats
+ */
+typedef struct mic_tcp_stats
+{
+  unsigned long pdu_sent; /* PDU envoyés, contrôle et renvois compris */
+  unsigned long pdu_received; /* PDU reçus */
+  unsigned long retransmissions; /* PDU de données renvoyés */
+  unsigned long fast_retransmits; /* dont renvoyés sur acks dupliqués, sans attendre le timer */
+  unsigned long timeouts; /* expirations du timer de retransmission */
+  unsigned long tolerated_losses; /* pertes acceptées sans renvoi (fiabilité partielle) */
+  unsigned long duplicates; /* PDU de données reçus alors qu'ils l'avaient déjà été */
+  unsigned long reordered; /* PDU de données reçus au-delà d'un trou, gardés pour être délivrés dans l'ordre */
+  unsigned long holes_skipped; /* PDU jamais reçus que le récepteur a sautés (fiabilité partielle) */
+  unsigned long acks_sent; /* acquittements envoyés */
+  unsigned long sacked; /* PDU en vol acquittés par un bloc SACK, sans l'ack individuel ni cumulatif */
+  unsigned long bytes_delivered; /* octets remis au buffer de réception de l'application */
+  unsigned long rto_usec; /* timer de retransmission courant, en µs */
+  unsigned long srtt_usec; /* RTT lissé en µs, 0 avant la première mesure */
+  unsigned long app_buffer_depth; /* messages en attente de mic_tcp_recv */
+  /* Percentiles (50, 99, 99,9 %) et maximum des latences en µs, 0 sans mesure :
+     du premier envoi d'un message à son ack (émetteur) */
+  unsigned long ack_latency_p50_usec;
+  unsigned long ack_latency_p99_usec;
+  unsigned long ack_latency_p999_usec;
+  unsigned long ack_latency_max_usec;
+  /* de sa soumission par l'application émettrice à sa lecture par mic_tcp_recv (récepteur) */
+  unsigned long delivery_latency_p50_usec;
+  unsigned long delivery_latency_p99_usec;
+  unsigned long delivery_latency_p999_usec;
+  unsigned long delivery_latency_max_usec;
+} mic_tcp_stats;
+
 typedef struct app_buffer
 {
     mic_tcp_payload packet;
@@ -94,12 +129,17 @@ typedef struct app_buffer
  * Fonctions de l'interface *
  ****************************/
 int mic_tcp_socket(start_mode sm);
+int mic_tcp_socket_policy(start_mode sm, const char* policy);
 int mic_tcp_bind(int socket, mic_tcp_sock_addr addr);
 int mic_tcp_accept(int socket, mic_tcp_sock_addr* addr);
 int mic_tcp_connect(int socket, mic_tcp_sock_addr addr);
 int mic_tcp_send (int socket, char* mesg, int mesg_size);
 int mic_tcp_recv (int socket, char* mesg, int max_mesg_size);
-void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr);
+void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket);
 int mic_tcp_close(int socket);
+unsigned long mic_tcp_get_rto(int socket);
+int mic_tcp_set_loss_tolerance(int socket, unsigned short percent);
+int mic_tcp_set_ack_delay(int socket, unsigned long delay_usec);
+int mic_tcp_get_stats(int socket, mic_tcp_stats* stats);
 
 #endif
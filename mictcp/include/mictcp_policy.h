@@ -0,0 +1,32 @@
+#ifndef MICTCP_POLICY_H
+#define MICTCP_POLICY_H
+
+#include <mictcp.h>
+
+/*
+ * Politique de fiabilité : les fonctions d'une version du protocole.
+ * Les fonctions de l'interface (src/mictcp.c) appellent celles de la
+ * politique choisie pour le socket à sa création.
+ */
+typedef struct mic_tcp_policy
+{
+  const char* name; /* nom donné à mic_tcp_socket_policy ou à MICTCP_POLICY */
+  int (*socket)(start_mode sm);
+  int (*bind)(int socket, mic_tcp_sock_addr addr);
+  int (*accept)(int socket, mic_tcp_sock_addr* addr);
+  int (*connect)(int socket, mic_tcp_sock_addr addr);
+  int (*send)(int socket, char* mesg, int mesg_size);
+  int (*recv)(int socket, char* mesg, int max_mesg_size);
+  int (*close)(int socket);
+  unsigned long (*get_rto)(int socket);
+  int (*set_loss_tolerance)(int socket, unsigned short percent);
+  int (*set_ack_delay)(int socket, unsigned long delay_usec);
+  void (*process_received_PDU)(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket);
+} mic_tcp_policy;
+
+extern const mic_tcp_policy mictcp_v1; /* sans garantie de fiabilité */
+extern const mic_tcp_policy mictcp_v2; /* stop and wait, fiabilité totale */
+extern const mic_tcp_policy mictcp_v3; /* stop and wait, fiabilité partielle négociée */
+extern const mic_tcp_policy mictcp_v4; /* selective repeat à fenêtre glissante */
+
+#endif
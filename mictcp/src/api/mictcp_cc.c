@@ -0,0 +1,229 @@
+#include <api/mictcp_core.h>
+#include <api/mictcp_cc.h>
+
+/* Trace of the windows, shared by every connection */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* trace_file = NULL;
+
+static unsigned int min_window(unsigned int a, unsigned int b)
+{
+    return (a < b) ? a : b;
+}
+
+/* After a fast retransmit: half the flight, the acks keep coming */
+static void halve(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    cc->ssthresh = (in_flight / 2 > CC_MIN_SSTHRESH) ? in_flight / 2 : CC_MIN_SSTHRESH;
+    cc->cwnd = cc->ssthresh;
+    cc->acked = 0;
+    cc->round_rtt = 0;
+}
+
+/* After a timeout, whatever the algorithm: half the flight, and one PDU to start again */
+static void collapse(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    halve(cc, in_flight);
+    cc->cwnd = 1;
+}
+
+static void reno_init(mic_tcp_cc* cc)
+{
+    cc->cwnd = CC_INITIAL_WINDOW;
+    cc->ssthresh = CC_MAX_WINDOW;
+    cc->acked = 0;
+}
+
+static void reno_ack(mic_tcp_cc* cc, unsigned int acked, unsigned long rtt_usec)
+{
+    /* Slow start: one PDU more per PDU acknowledged, up to ssthresh */
+    if(cc->cwnd < cc->ssthresh) {
+        unsigned int room = cc->ssthresh - cc->cwnd;
+        unsigned int grow = min_window(acked, room);
+        cc->cwnd += grow;
+        acked -= grow;
+    }
+
+    /* Congestion avoidance: one PDU more per window acknowledged */
+    cc->acked += acked;
+    while(cc->acked >= cc->cwnd && cc->cwnd < CC_MAX_WINDOW) {
+        cc->acked -= cc->cwnd;
+        cc->cwnd++;
+    }
+}
+
+static void reno_loss(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    halve(cc, in_flight);
+}
+
+static void reno_timeout(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    collapse(cc, in_flight);
+}
+
+static void vegas_init(mic_tcp_cc* cc)
+{
+    reno_init(cc);
+    cc->base_rtt = 0;
+    cc->round_rtt = 0;
+}
+
+/*
+ * The window changes once per round (a window of PDUs acknowledged), from the
+ * PDUs the round kept queued along the path: cwnd * (rtt - base_rtt) / rtt.
+ * Slow start doubles the window each round until this reaches CC_VEGAS_GAMMA.
+ */
+static void vegas_ack(mic_tcp_cc* cc, unsigned int acked, unsigned long rtt_usec)
+{
+    if(rtt_usec > 0) {
+        if(cc->base_rtt == 0 || rtt_usec < cc->base_rtt) cc->base_rtt = rtt_usec;
+        if(cc->round_rtt == 0 || rtt_usec < cc->round_rtt) cc->round_rtt = rtt_usec;
+    }
+
+    cc->acked += acked;
+    if(cc->acked < cc->cwnd) return;
+    cc->acked = 0;
+    if(cc->round_rtt == 0) return;
+
+    unsigned long queued = cc->cwnd * (cc->round_rtt - cc->base_rtt) / cc->round_rtt;
+    cc->round_rtt = 0;
+
+    if(cc->cwnd < cc->ssthresh) {
+        if(queued > CC_VEGAS_GAMMA) {
+            cc->ssthresh = cc->cwnd;
+        } else {
+            cc->cwnd = min_window(2 * cc->cwnd, min_window(cc->ssthresh, CC_MAX_WINDOW));
+        }
+    } else if(queued < CC_VEGAS_ALPHA && cc->cwnd < CC_MAX_WINDOW) {
+        cc->cwnd++;
+    } else if(queued > CC_VEGAS_BETA && cc->cwnd > CC_MIN_SSTHRESH) {
+        cc->cwnd--;
+    }
+}
+
+static void vegas_loss(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    halve(cc, in_flight);
+}
+
+static void vegas_timeout(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    collapse(cc, in_flight);
+}
+
+static void none_init(mic_tcp_cc* cc)
+{
+    cc->cwnd = CC_MAX_WINDOW;
+    cc->ssthresh = CC_MAX_WINDOW;
+    cc->acked = 0;
+}
+
+static void none_ack(mic_tcp_cc* cc, unsigned int acked, unsigned long rtt_usec) {}
+
+static void none_loss(mic_tcp_cc* cc, unsigned int in_flight) {}
+
+static void none_timeout(mic_tcp_cc* cc, unsigned int in_flight) {}
+
+static const mic_tcp_cc_ops algorithms[] = {
+    {"reno", reno_init, reno_ack, reno_loss, reno_timeout},
+    {"vegas", vegas_init, vegas_ack, vegas_loss, vegas_timeout},
+    {"none", none_init, none_ack, none_loss, none_timeout},
+};
+
+static const mic_tcp_cc_ops* default_ops = &algorithms[0];
+
+static const mic_tcp_cc_ops* find(const char* algorithm)
+{
+    for(int i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+        if(strcmp(algorithms[i].name, algorithm) == 0) return &algorithms[i];
+    }
+    return NULL;
+}
+
+static void trace(mic_tcp_cc* cc, const char* event)
+{
+    pthread_mutex_lock(&trace_lock);
+    if(trace_file != NULL) {
+        fprintf(trace_file, "%lu,%d,%s,%u,%u,%s\n", get_now_time_usec(), cc->socket, cc->ops->name,
+                cc->cwnd, cc->ssthresh, event);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Starts the congestion control of a connection with the named algorithm
+ * (NULL: the default one, see cc_set_default). Returns -1 if the name is
+ * unknown, the default algorithm being used.
+ */
+int cc_init(mic_tcp_cc* cc, const char* algorithm, int socket)
+{
+    const mic_tcp_cc_ops* ops = (algorithm != NULL) ? find(algorithm) : default_ops;
+    int result = (ops != NULL) ? 0 : -1;
+
+    cc->ops = (ops != NULL) ? ops : default_ops;
+    cc->socket = socket;
+    cc->ops->init(cc);
+    trace(cc, "init");
+    return result;
+}
+
+/* New data acknowledged: acked PDUs, with the RTT of one of them if it was sent once (0 otherwise) */
+void cc_ack(mic_tcp_cc* cc, unsigned int acked, unsigned long rtt_usec)
+{
+    unsigned int cwnd = cc->cwnd, ssthresh = cc->ssthresh;
+
+    cc->ops->on_ack(cc, acked, rtt_usec);
+    if(cc->cwnd != cwnd || cc->ssthresh != ssthresh) trace(cc, "ack");
+}
+
+/* Loss detected by duplicate acks, once per fast recovery, with the PDUs in flight then */
+void cc_loss(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    cc->ops->on_loss(cc, in_flight);
+    trace(cc, "loss");
+}
+
+/* Retransmission timer expiry, once per expiry round, with the PDUs in flight then */
+void cc_timeout(mic_tcp_cc* cc, unsigned int in_flight)
+{
+    cc->ops->on_timeout(cc, in_flight);
+    trace(cc, "timeout");
+}
+
+unsigned int cc_window(mic_tcp_cc* cc)
+{
+    return cc->cwnd;
+}
+
+/* Algorithm of the connections created from now on. Returns -1 if the name is unknown */
+int cc_set_default(const char* algorithm)
+{
+    const mic_tcp_cc_ops* ops = find(algorithm);
+
+    if(ops == NULL) return -1;
+    default_ops = ops;
+    return 0;
+}
+
+/*
+ * Writes every change of a congestion window to path, one CSV line each:
+ * time_us,socket,algorithm,cwnd,ssthresh,event. A NULL path stops the trace.
+ */
+int cc_trace(const char* path)
+{
+    FILE* file = NULL;
+
+    if(path != NULL) {
+        if((file = fopen(path, "w")) == NULL) {
+            perror(path);
+            return -1;
+        }
+        fprintf(file, "time_us,socket,algorithm,cwnd,ssthresh,event\n");
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    if(trace_file != NULL) fclose(trace_file);
+    trace_file = file;
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
@@ -1,6 +1,8 @@
+#define _GNU_SOURCE /* ppoll */
 #include <api/mictcp_core.h>
 #include <sys/time.h>
-#include <sys/queue.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <math.h>
 #include <time.h>
 #include <pthread.h>
@@ -12,24 +14,129 @@
 int initialized = -1;
 int sys_socket;
 pthread_t listen_th;
-pthread_mutex_t lock;
-unsigned short  loss_rate = 0;
+unsigned short  batch_size = 1;
+int sack = 1;   /* selective acknowledgements offered by new connections, see set_sack */
+unsigned short dupack_threshold = DUPACK_THRESHOLD;
+unsigned long ack_delay = ACK_DELAY;
+unsigned long reorder_hold = REORDER_HOLD;
 struct sockaddr_in remote_addr;
 
-/* This is for the buffer */
-TAILQ_HEAD(tailhead, app_buffer_entry) app_buffer_head;
-struct tailhead *headp;
-struct app_buffer_entry {
-     mic_tcp_payload bf;
-     TAILQ_ENTRY(app_buffer_entry) entries;
+/* This is for the buffer, one per socket: filled by the reception thread, emptied by mic_tcp_recv */
+mic_tcp_ring app_buffer_ring[MAX_SOCKETS];
+
+/* Socket descriptor table */
+pthread_mutex_t socket_lock = PTHREAD_MUTEX_INITIALIZER;
+char socket_used[MAX_SOCKETS];
+void (*socket_hook)(int socket) = NULL;    /* told of every new socket, see set_socket_hook */
+
+/*
+ * Demultiplexing table: (remote address, remote port, local port) -> socket.
+ * Listening sockets are registered with a null remote address and port.
+ */
+#define DEMUX_BUCKETS 1024
+
+struct demux_entry {
+    in_addr_t ip;
+    unsigned short remote_port;
+    unsigned short local_port;
+    struct sockaddr_in udp_addr;    /* where the remote core receives */
+    int socket;
+    struct demux_entry* next;
 };
 
-/* Condition variable used for passive wait when buffer is empty */
-pthread_cond_t buffer_empty_cond;
+pthread_rwlock_t demux_lock = PTHREAD_RWLOCK_INITIALIZER;
+struct demux_entry* demux_table[DEMUX_BUCKETS];
+
+/*
+ * Shared-memory inbox of this core, read instead of the socket when set; the
+ * bridging thread moves what still arrives on the socket into it.
+ */
+shm_ring* inbox = NULL;
+unsigned short inbox_port;
+struct sockaddr_in inbox_addr;      /* where local peers answer */
+pthread_t bridge_th;
+
+/* Inboxes of the local peers, by UDP port, checked again every SHM_PEER_CHECK µs */
+#define SHM_PEERS 64
+#define SHM_PEER_CHECK 1000000
+
+struct shm_peer {
+    unsigned short port;
+    shm_ring* ring;             /* NULL: no live core behind this port */
+    unsigned long checked;
+};
+
+pthread_mutex_t shm_peer_lock = PTHREAD_MUTEX_INITIALIZER;
+struct shm_peer shm_peers[SHM_PEERS];
+
+/* Source of the last datagram received by the calling thread */
+static __thread struct sockaddr_in last_src;
+static __thread char last_src_ip[INET_ADDRSTRLEN];
+static __thread in_addr_t last_src_bin = INADDR_NONE;  /* address formatted in last_src_ip */
+
+/* Datagrams queued by IP_send between IP_send_begin and IP_send_flush */
+struct send_batch {
+    int count;
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    struct sockaddr_in dests[MAX_BATCH];
+    char data[MAX_BATCH][1500];
+};
+static __thread struct send_batch* send_batch = NULL;
+static __thread int batching = 0;
 
 /*************************
  * Fonctions Utilitaires *
  *************************/
+static void shm_stop()
+{
+    shm_ring_destroy(inbox, inbox_port);
+}
+
+/* Creates the inbox of this core, named after its UDP port */
+static void shm_start()
+{
+    struct sockaddr_in local_addr;
+    socklen_t len = sizeof(local_addr);
+
+    if(getsockname(sys_socket, (struct sockaddr *) &local_addr, &len) == -1) return;
+
+    inbox_port = ntohs(local_addr.sin_port);
+    inbox = shm_ring_create(inbox_port);
+    if(inbox == NULL) return;
+
+    memset(&inbox_addr, 0, sizeof(inbox_addr));
+    inbox_addr.sin_family = AF_INET;
+    inbox_addr.sin_port = local_addr.sin_port;
+    inbox_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    atexit(shm_stop);
+    pthread_create(&bridge_th, NULL, bridging, NULL);
+}
+
+/* Inbox of the core at dest if it runs on this host, NULL otherwise */
+static shm_ring* shm_peer(struct sockaddr_in* dest)
+{
+    if((ntohl(dest->sin_addr.s_addr) >> 24) != 127) return NULL;
+
+    unsigned short port = ntohs(dest->sin_port);
+    struct shm_peer* p = &shm_peers[port % SHM_PEERS];
+    unsigned long now = get_now_time_usec();
+
+    pthread_mutex_lock(&shm_peer_lock);
+    if(p->port != port || now - p->checked >= SHM_PEER_CHECK
+       || (p->ring != NULL && __atomic_load_n(&p->ring->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC)) {
+        /* The peer may have started, stopped or been replaced since */
+        if(p->ring != NULL) shm_ring_detach(p->ring);
+        p->port = port;
+        p->ring = shm_ring_attach(port);
+        p->checked = now;
+    }
+    shm_ring* ring = p->ring;
+    pthread_mutex_unlock(&shm_peer_lock);
+
+    return ring;
+}
+
 int initialize_components(start_mode mode)
 {
     int bnd;
@@ -37,13 +144,44 @@ int initialize_components(start_mode mode)
     struct sockaddr_in local_addr;
 
     if(initialized != -1) return initialized;
+
+    /* A trace named in the environment overrides the loss rate of the version */
+    if((getenv("MICTCP_TRACE") != NULL) && (set_loss_trace(getenv("MICTCP_TRACE")) == -1)) return -1;
+
+    /* Counters of every socket appended to this file, each MICTCP_STATS_INTERVAL ms */
+    if((getenv("MICTCP_STATS") != NULL)
+       && (set_stats_dump(getenv("MICTCP_STATS"), (getenv("MICTCP_STATS_INTERVAL") != NULL) ? atol(getenv("MICTCP_STATS_INTERVAL")) : 0) == -1)) return -1;
+
+    /* Congestion control of the connections created from now on, and the trace of their windows */
+    if((getenv("MICTCP_CC") != NULL) && (set_congestion_control(getenv("MICTCP_CC")) == -1)) {
+        LOG_ERROR("[MICTCP-CORE] Controle de congestion inconnu : %s", getenv("MICTCP_CC"));
+        return -1;
+    }
+    if((getenv("MICTCP_CC_TRACE") != NULL) && (set_cwnd_trace(getenv("MICTCP_CC_TRACE")) == -1)) return -1;
+
+    /* MICTCP_SACK=0 stops offering selective acknowledgements */
+    if(getenv("MICTCP_SACK") != NULL) set_sack(atoi(getenv("MICTCP_SACK")));
+
+    /* Duplicate acks that trigger a fast retransmit, 0 leaves loss recovery to the timer */
+    if(getenv("MICTCP_DUPACK") != NULL) set_dupack_threshold(atoi(getenv("MICTCP_DUPACK")));
+
+    /* Longest wait for a second PDU before acking the first, 0 acks every PDU at once */
+    if(getenv("MICTCP_ACK_DELAY") != NULL) set_ack_delay(atol(getenv("MICTCP_ACK_DELAY")));
+
+    /* How long a hole may hold back what follows it when losses are tolerated */
+    if(getenv("MICTCP_REORDER_HOLD") != NULL) set_reorder_hold(atol(getenv("MICTCP_REORDER_HOLD")));
+
+    /* Both ends share the simulated link: no socket and no listening thread */
+    if(sim_enabled()) {
+        initialized = 1;
+        return initialized;
+    }
+
     if((sys_socket = socket(AF_INET, SOCK_DGRAM, 0)) == -1) return -1;
     else initialized = 1;
 
     if((mode == SERVER) & (initialized != -1))
     {
-        TAILQ_INIT(&app_buffer_head);
-        pthread_cond_init(&buffer_empty_cond, 0);
         memset((char *) &local_addr, 0, sizeof(local_addr));
         local_addr.sin_family = AF_INET;
         local_addr.sin_port = htons(API_CS_Port);
@@ -81,9 +219,22 @@ int initialize_components(start_mode mode)
             local_addr.sin_port = htons(API_SC_Port);
             local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
             bnd = bind(sys_socket, (struct sockaddr *) &local_addr, sizeof(local_addr));
+
+            /* Another client already owns the port: servers answer to
+               the actual source address, so any port will do */
+            if (bnd == -1) {
+                local_addr.sin_port = 0;
+                bind(sys_socket, (struct sockaddr *) &local_addr, sizeof(local_addr));
+            }
         }
     }
 
+    /* Same-host peers are reached through shared memory, unless MICTCP_SHM=0 */
+    if((initialized == 1) && ((getenv("MICTCP_SHM") == NULL) || (atoi(getenv("MICTCP_SHM")) != 0)))
+    {
+        shm_start();
+    }
+
     if((initialized == 1) && (mode == SERVER))
     {
         pthread_create (&listen_th, NULL, listening, "1");
@@ -103,10 +254,14 @@ int IP_send(mic_tcp_pdu pk, mic_tcp_sock_addr addr)
         result = -1;
 
     } else {
-        mic_tcp_payload tmp = get_full_stream(pk);
-        int sent_size =  mic_tcp_core_send(tmp);
+        struct sockaddr_in dest;
+
+        /* Known connections are answered where their datagrams come from */
+        if(demux_udp_addr(addr, pk.header.source_port, &dest) == -1) {
+            dest = remote_addr;
+        }
 
-        free (tmp.data);
+        int sent_size = mic_tcp_core_send(&pk, &dest);
 
         /* Correct the sent size */
         result = (sent_size == -1) ? -1 : sent_size - API_HD_Size;
@@ -115,78 +270,111 @@ int IP_send(mic_tcp_pdu pk, mic_tcp_sock_addr addr)
     return result;
 }
 
-int IP_recv(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout)
+/* Source address of the last datagram, valid until the next reception by this thread */
+static void source_addr(mic_tcp_sock_addr* addr, unsigned short port)
 {
-    int result = -1;
+    if (last_src.sin_addr.s_addr != last_src_bin) {
+        inet_ntop(AF_INET, &last_src.sin_addr, last_src_ip, sizeof(last_src_ip));
+        last_src_bin = last_src.sin_addr.s_addr;
+    }
+    addr->ip_addr = last_src_ip;
+    addr->ip_addr_size = strlen(addr->ip_addr) + 1; // don't forget '\0'
+    addr->port = port;
+}
 
-    struct timeval tv;
-    struct sockaddr_in tmp_addr;
-    socklen_t tmp_addr_size = sizeof(struct sockaddr);
+/*
+ * Shared by IP_recv and IP_recv_us: a null timeout blocks when wait is set,
+ * otherwise only collects what is already queued.
+ * The datagram is scattered straight into the caller's header and payload.
+ */
+static int ip_recv_wait(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout_usec, int wait)
+{
+    int result = -1;
+    int flags = 0;
 
     /* Send data over a fake IP */
     if(initialized == -1) {
         return -1;
     }
 
-    /* Compute the number of entire seconds */
-    tv.tv_sec = timeout / 1000;
-    /* Convert the remainder to microseconds */
-    tv.tv_usec = (timeout - tv.tv_sec * 1000) * 1000;
-
-    /* Create a reception buffer */
-    int buffer_size = API_HD_Size + pk->payload.size;
-    char *buffer = malloc(buffer_size);
+    if(sim_enabled()) {
+        return sim_recv(pk, addr, timeout_usec, wait);
+    }
 
-    if ((setsockopt(sys_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) >= 0) {
-       result = recvfrom(sys_socket, buffer, buffer_size, 0, (struct sockaddr *)&tmp_addr, &tmp_addr_size);
+    if(inbox != NULL) {
+        result = shm_ring_get(inbox, &last_src, &pk->header, API_HD_Size, pk->payload.data,
+                              (pk->payload.size > 0) ? pk->payload.size : 0, timeout_usec, wait);
+        if(result != -1 && result < API_HD_Size) {
+            return -1; /* No complete header: not a PDU */
+        }
+        if(result != -1) {
+            result -= API_HD_Size;
+            pk->payload.size = result;
+            if(addr != NULL) {
+                source_addr(addr, pk->header.source_port);
+            }
+        }
+        return result;
     }
 
-    if (result != -1) {
-        /* Create the mic_tcp_pdu */
-        memcpy (&(pk->header), buffer, API_HD_Size);
-        pk->payload.size = result - API_HD_Size;
-        memcpy (pk->payload.data, buffer + API_HD_Size, pk->payload.size);
+    /* Wait on the socket rather than changing its SO_RCVTIMEO on every call */
+    if(timeout_usec > 0) {
+        struct pollfd pfd = {sys_socket, POLLIN, 0};
+        struct timespec ts = {timeout_usec / 1000000, (timeout_usec % 1000000) * 1000};
 
-        /* Generate a stub address */
-        if (addr != NULL) {
-            addr->ip_addr = "localhost";
-            addr->ip_addr_size = strlen(addr->ip_addr) + 1; // don't forget '\0'
-            addr->port = pk->header.source_port;
+        if(ppoll(&pfd, 1, &ts, NULL) <= 0) {
+            return -1;
         }
+        flags = MSG_DONTWAIT;
+    } else if(!wait) {
+        flags = MSG_DONTWAIT;
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = &pk->header;
+    iov[0].iov_len = API_HD_Size;
+    iov[1].iov_base = pk->payload.data;
+    iov[1].iov_len = pk->payload.size;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &last_src;
+    msg.msg_namelen = sizeof(last_src);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (pk->payload.size > 0) ? 2 : 1;
+
+    result = recvmsg(sys_socket, &msg, flags);
+
+    if (result != -1 && result < API_HD_Size) {
+        /* A datagram shorter than the header is not a PDU: reported like a timeout */
+        return -1;
+    }
 
+    if (result != -1) {
         /* Correct the receved size */
         result -= API_HD_Size;
-    }
+        pk->payload.size = result;
 
-    /* Free the reception buffer */
-    free(buffer);
+        if (addr != NULL) {
+            source_addr(addr, pk->header.source_port);
+        }
+    }
 
     return result;
 }
 
-mic_tcp_payload get_full_stream(mic_tcp_pdu pk)
+int IP_recv(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout)
 {
-    /* Get a full packet from data and header */
-    mic_tcp_payload tmp;
-    tmp.size = API_HD_Size + pk.payload.size;
-    tmp.data = malloc (tmp.size);
-
-    memcpy (tmp.data, &pk.header, API_HD_Size);
-    memcpy (tmp.data + API_HD_Size, pk.payload.data, pk.payload.size);
-
-    return tmp;
+    /* A null timeout blocks until a datagram arrives */
+    return ip_recv_wait(pk, addr, timeout * 1000, 1);
 }
 
-mic_tcp_payload get_mic_tcp_data(ip_payload buff)
+int IP_recv_us(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout)
 {
-    mic_tcp_payload tmp;
-    tmp.size = buff.size-API_HD_Size;
-    tmp.data = malloc(tmp.size);
-    memcpy(tmp.data, buff.data+API_HD_Size, tmp.size);
-    return tmp;
+    /* A null timeout only collects what is already queued */
+    return ip_recv_wait(pk, addr, timeout, 0);
 }
 
-
 mic_tcp_header get_mic_tcp_header(ip_payload packet)
 {
     /* Get a struct header from an incoming packet */
@@ -195,131 +383,565 @@ mic_tcp_header get_mic_tcp_header(ip_payload packet)
     return tmp;
 }
 
-int full_send(mic_tcp_payload buff)
+/* The PDU is copied: callers may reuse their buffers before the flush */
+static int queue_datagram(mic_tcp_pdu* pk, struct sockaddr_in* dest)
 {
-    int result = 0;
+    int size = API_HD_Size + pk->payload.size;
 
-    result = sendto(sys_socket, buff.data, buff.size, 0, (struct sockaddr *)&remote_addr, sizeof(remote_addr));
+    /* A slot holds one 1500-byte datagram */
+    if(pk->payload.size < 0 || size > (int) sizeof(send_batch->data[0])) {
+        LOG_ERROR("[MICTCP-CORE] Paquet trop long : %d octets", size);
+        return -1;
+    }
+    int i = send_batch->count++;
 
-    return result;
+    memcpy(send_batch->data[i], &pk->header, API_HD_Size);
+    memcpy(send_batch->data[i] + API_HD_Size, pk->payload.data, pk->payload.size);
+    send_batch->dests[i] = *dest;
+
+    send_batch->iovs[i].iov_base = send_batch->data[i];
+    send_batch->iovs[i].iov_len = size;
+    memset(&send_batch->msgs[i], 0, sizeof(struct mmsghdr));
+    send_batch->msgs[i].msg_hdr.msg_name = &send_batch->dests[i];
+    send_batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    send_batch->msgs[i].msg_hdr.msg_iov = &send_batch->iovs[i];
+    send_batch->msgs[i].msg_hdr.msg_iovlen = 1;
+
+    if(send_batch->count >= batch_size && IP_send_flush_queue() == -1) {
+        return -1;
+    }
+    return size;
 }
 
-int mic_tcp_core_send(mic_tcp_payload buff)
+/* Header and payload are gathered by the kernel, no intermediate copy */
+static int send_datagram(mic_tcp_pdu* pk, struct sockaddr_in* dest)
 {
-    int random = rand();
-    int result = buff.size;
-    int lr_tresh = (int) round(((float)loss_rate/100.0)*RAND_MAX);
+    struct iovec iov[2];
+    iov[0].iov_base = &pk->header;
+    iov[0].iov_len = API_HD_Size;
+    iov[1].iov_base = pk->payload.data;
+    iov[1].iov_len = pk->payload.size;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = dest;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (pk->payload.size > 0) ? 2 : 1;
+
+    return sendmsg(sys_socket, &msg, 0);
+}
 
-    if(random > lr_tresh) {
-        result = sendto(sys_socket, buff.data, buff.size, 0, (struct sockaddr *)&remote_addr, sizeof(struct sockaddr));
-    } else {
-        printf("[MICTCP-CORE] Perte du paquet\n");
+/*
+ * Every datagram goes through the impairment stage: it may be lost, duplicated,
+ * or delayed, delayed copies being sent later by the delivery thread
+ */
+int mic_tcp_core_send(mic_tcp_pdu* pk, struct sockaddr_in* dest)
+{
+    unsigned long delays[IMPAIR_MAX_COPIES];
+    int result = API_HD_Size + pk->payload.size;
+    if(sim_enabled()) sim_account(pk);
+    int copies = impair_packet(result, delays);
+    shm_ring* peer;
+
+    if(copies == 0) {
+        LOG_DEBUG("[MICTCP-CORE] Perte du paquet");
+    }
+
+    for(int i = 0; i < copies && result != -1; i++) {
+        if(sim_enabled()) {
+            if(sim_send(pk, delays[i]) == -1) result = -1;
+        } else if(delays[i] > 0) {
+            impair_schedule(sys_socket, &pk->header, API_HD_Size, pk->payload.data, pk->payload.size, dest, delays[i]);
+        } else if(inbox != NULL && (peer = shm_peer(dest)) != NULL) {
+            /* A full inbox loses the datagram, as a full socket buffer would */
+            shm_ring_put(peer, &inbox_addr, &pk->header, API_HD_Size, pk->payload.data, pk->payload.size);
+        } else {
+            result = batching ? queue_datagram(pk, dest) : send_datagram(pk, dest);
+        }
     }
 
     return result;
 }
 
-int app_buffer_get(mic_tcp_payload app_buff)
+/* Sends the queued datagrams, keeps batching */
+int IP_send_flush_queue()
 {
-    /* A pointer to a buffer entry */
-    struct app_buffer_entry * entry;
-
-    /* The actual size passed to the application */
-    int result = 0;
-
-    /* Lock a mutex to protect the buffer from corruption */
-    pthread_mutex_lock(&lock);
+    int sent = 0;
 
-    /* If the buffer is empty, we wait for insertion */
-    while(app_buffer_head.tqh_first == NULL) {
-          pthread_cond_wait(&buffer_empty_cond, &lock);
+    while(sent < send_batch->count) {
+        int nb = sendmmsg(sys_socket, send_batch->msgs + sent, send_batch->count - sent, 0);
+        if(nb == -1) {
+            send_batch->count = 0;
+            return -1;
+        }
+        sent += nb;
     }
+    send_batch->count = 0;
 
-    /* When we execute the code below, the following conditions are true:
-       - The buffer contains at least 1 element
-       - We hold the lock on the mutex
-    */
+    return sent;
+}
 
-    /* The entry we want is the first one in the buffer */
-    entry = app_buffer_head.tqh_first;
+void IP_send_begin()
+{
+    if(batch_size <= 1) return;
 
-    /* How much data are we going to deliver to the application ? */
-    result = min_size(entry->bf.size, app_buff.size);
+    if(send_batch == NULL) {
+        /* Without a batch, IP_send keeps sending each datagram at once */
+        send_batch = malloc(sizeof(struct send_batch));
+        if(send_batch == NULL) return;
+        send_batch->count = 0;
+    }
+    batching = 1;
+}
 
-    /* We copy the actual data in the application allocated buffer */
-    memcpy(app_buff.data, entry->bf.data, result);
+int IP_send_flush()
+{
+    if(!batching) return 0;
 
-    /* We remove the entry from the buffer */
-    TAILQ_REMOVE(&app_buffer_head, entry, entries);
+    batching = 0;
+    return IP_send_flush_queue();
+}
 
-    /* Release the mutex */
-    pthread_mutex_unlock(&lock);
+int app_buffer_get(int socket, mic_tcp_payload app_buff)
+{
+    unsigned int timestamp;
 
-    /* Clean up memory */
-    free(entry->bf.data);
-    free(entry);
+    /* Waits for a message if the buffer is empty, the copy is cut to the application buffer */
+    int result = ring_get(&app_buffer_ring[socket], app_buff.data, app_buff.size, &timestamp);
 
+    /* Both dates wrap together on 32 bits, the difference holds up to 71 minutes */
+    stats_delivery_latency(socket, (unsigned int) get_now_time_usec() - timestamp);
     return result;
 }
 
-void app_buffer_put(mic_tcp_payload bf)
+/* timestamp: the submission date carried by the PDU header, for the delivery latency */
+int app_buffer_put(int socket, mic_tcp_payload bf, unsigned int timestamp)
+{
+    /* The buffer is bounded: a message that does not fit is dropped */
+    if(ring_put(&app_buffer_ring[socket], bf.data, bf.size, timestamp) == -1) {
+        LOG_DEBUG("[MICTCP-CORE] Buffer de reception plein");
+        return -1;
+    }
+
+    return 0;
+}
+
+unsigned int app_buffer_free(int socket)
 {
-    /* Prepare a buffer entry to store the data */
-    struct app_buffer_entry * entry = malloc(sizeof(struct app_buffer_entry));
-    entry->bf.size = bf.size;
-    entry->bf.data = malloc(bf.size);
-    memcpy(entry->bf.data, bf.data, bf.size);
+    /* Messages that can still be stored, as seen by the reception thread */
+    return ring_free_slots(&app_buffer_ring[socket]);
+}
 
-    /* Lock a mutex to protect the buffer from corruption */
-    pthread_mutex_lock(&lock);
+unsigned int app_buffer_depth(int socket)
+{
+    /* Messages waiting for mic_tcp_recv */
+    if(socket < 0 || socket >= MAX_SOCKETS || app_buffer_ring[socket].slots == NULL) return 0;
+    return app_buffer_ring[socket].capacity - ring_free_slots(&app_buffer_ring[socket]);
+}
 
-    /* Insert the packet in the buffer, at the end of it */
-    TAILQ_INSERT_TAIL(&app_buffer_head, entry, entries);
+int app_buffer_set_capacity(int socket, unsigned int capacity)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return -1;
 
-    /* Release the mutex */
-    pthread_mutex_unlock(&lock);
+    /* Only an empty buffer can be resized */
+    mic_tcp_ring* r = &app_buffer_ring[socket];
+    if(r->tail != r->head) return -1;
 
-    /* We can now signal to any potential thread waiting that the buffer is
-       no longer empty */
-    pthread_cond_broadcast(&buffer_empty_cond);
+    ring_destroy(r);
+    return ring_init(r, capacity);
 }
 
 
 
 void* listening(void* arg)
 {
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH][2];
+    mic_tcp_header headers[MAX_BATCH];
+    struct sockaddr_in sources[MAX_BATCH];
     mic_tcp_pdu pdu_tmp;
-    int recv_size;
     mic_tcp_sock_addr remote;
 
-    pthread_mutex_init(&lock, NULL);
-
-    printf("[MICTCP-CORE] Demarrage du thread de reception reseau...\n");
+    LOG_INFO("[MICTCP-CORE] Demarrage du thread de reception reseau...");
 
     const int payload_size = 1500 - API_HD_Size;
-    pdu_tmp.payload.size = payload_size;
-    pdu_tmp.payload.data = malloc(payload_size);
-
+    char* payloads = malloc(MAX_BATCH * payload_size);
+    if(payloads == NULL) {
+        LOG_ERROR("[MICTCP-CORE] Pas de memoire pour le thread de reception");
+        return NULL;
+    }
 
     while(1)
     {
-        pdu_tmp.payload.size = payload_size;
-        recv_size = IP_recv(&pdu_tmp, &remote, 0);
+        /* Up to batch_size datagrams per syscall, waiting only for the first one */
+        int count = batch_size;
+        for(int i = 0; i < count; i++) {
+            iovs[i][0].iov_base = &headers[i];
+            iovs[i][0].iov_len = API_HD_Size;
+            iovs[i][1].iov_base = payloads + i * payload_size;
+            iovs[i][1].iov_len = payload_size;
+
+            memset(&msgs[i], 0, sizeof(struct mmsghdr));
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 2;
+        }
 
-        if(recv_size != -1)
-        {
-            process_received_PDU(pdu_tmp, remote);
+        int received;
+        if(inbox != NULL) {
+            /* The same batch from the inbox */
+            for(received = 0; received < count; received++) {
+                int size = shm_ring_get(inbox, &sources[received], &headers[received], API_HD_Size,
+                                        payloads + received * payload_size, payload_size, 0, received == 0);
+                if(size == -1) break;
+                msgs[received].msg_len = size;
+            }
         } else {
+            received = recvmmsg(sys_socket, msgs, count, MSG_WAITFORONE, NULL);
+        }
+
+        if(received == -1)
+        {
             /* This should never happen */
-            printf("Error in recv\n");
+            LOG_ERROR("[MICTCP-CORE] Error in recv");
+            continue;
+        }
+
+        /* The answers of the whole batch leave together */
+        IP_send_begin();
+        for(int i = 0; i < received; i++) {
+            if(msgs[i].msg_len < API_HD_Size) continue; /* No complete header: not a PDU */
+            pdu_tmp.header = headers[i];
+            pdu_tmp.payload.data = payloads + i * payload_size;
+            pdu_tmp.payload.size = msgs[i].msg_len - API_HD_Size;
+
+            last_src = sources[i];
+            source_addr(&remote, pdu_tmp.header.source_port);
+
+            process_received_PDU(pdu_tmp, remote, demux_lookup(&pdu_tmp, &remote));
         }
+        IP_send_flush();
     }
 }
 
+/* Moves the datagrams still received on the socket (remote peers, delayed ones) into the inbox */
+void* bridging(void* arg)
+{
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    struct sockaddr_in sources[MAX_BATCH];
+    char* datagrams = malloc(MAX_BATCH * SHM_SLOT_SIZE);
+    if(datagrams == NULL) {
+        LOG_ERROR("[MICTCP-CORE] Pas de memoire pour le thread de passerelle");
+        return NULL;
+    }
+
+    while(1)
+    {
+        for(int i = 0; i < MAX_BATCH; i++) {
+            iovs[i].iov_base = datagrams + i * SHM_SLOT_SIZE;
+            iovs[i].iov_len = SHM_SLOT_SIZE;
+
+            memset(&msgs[i], 0, sizeof(struct mmsghdr));
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(sys_socket, msgs, MAX_BATCH, MSG_WAITFORONE, NULL);
+
+        for(int i = 0; i < received; i++) {
+            if(msgs[i].msg_len < API_HD_Size) continue;
+            shm_ring_put(inbox, &sources[i], iovs[i].iov_base, API_HD_Size,
+                         (char*) iovs[i].iov_base + API_HD_Size, msgs[i].msg_len - API_HD_Size);
+        }
+    }
+}
+
+/*************************
+ * Socket table & demux  *
+ *************************/
+int socket_alloc()
+{
+    int socket = -1;
+
+    pthread_mutex_lock(&socket_lock);
+    for(int i = 0; i < MAX_SOCKETS; i++) {
+        if(!socket_used[i]) {
+            if(app_buffer_ring[i].slots == NULL && ring_init(&app_buffer_ring[i], RING_DEFAULT_CAPACITY) == -1) break;
+            socket_used[i] = 1;
+            socket = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&socket_lock);
+
+    if(socket != -1) {
+        stats_reset(socket);
+        if(socket_hook != NULL) socket_hook(socket);
+    }
+    return socket;
+}
+
+int socket_in_use(int socket)
+{
+    return socket >= 0 && socket < MAX_SOCKETS && __atomic_load_n(&socket_used[socket], __ATOMIC_RELAXED);
+}
+
+/* Lets the layer above tag the sockets a version allocates, in the allocating thread */
+void set_socket_hook(void (*hook)(int socket))
+{
+    socket_hook = hook;
+}
+
+void socket_free(int socket)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+
+    stats_release(socket);
+
+    /* Drop undelivered data and give the memory back */
+    ring_destroy(&app_buffer_ring[socket]);
+
+    pthread_mutex_lock(&socket_lock);
+    socket_used[socket] = 0;
+    pthread_mutex_unlock(&socket_lock);
+}
+
+/* Dotted address or host name to network address, 0 if unknown */
+static in_addr_t resolve(char* ip_addr)
+{
+    static __thread char last_name[64];
+    static __thread in_addr_t last_ip;
+    struct in_addr in;
+    struct hostent * hp;
+
+    if(ip_addr == NULL) return 0;
+    if(inet_aton(ip_addr, &in)) return in.s_addr;
+
+    /* Host names are resolved once */
+    if(strncmp(ip_addr, last_name, sizeof(last_name)) != 0) {
+        if((hp = gethostbyname(ip_addr)) == NULL) return 0;
+        memcpy(&last_ip, hp->h_addr, sizeof(last_ip));
+        strncpy(last_name, ip_addr, sizeof(last_name) - 1);
+    }
+    return last_ip;
+}
+
+static unsigned int demux_hash(in_addr_t ip, unsigned short remote_port, unsigned short local_port)
+{
+    unsigned int h = ntohl(ip) ^ ((unsigned int) remote_port << 16) ^ local_port;
+    return (h * 2654435761u) % DEMUX_BUCKETS;
+}
+
+/* Must be called with demux_lock held */
+static struct demux_entry* demux_find(in_addr_t ip, unsigned short remote_port, unsigned short local_port)
+{
+    struct demux_entry* e = demux_table[demux_hash(ip, remote_port, local_port)];
+
+    while(e != NULL && (e->ip != ip || e->remote_port != remote_port || e->local_port != local_port)) {
+        e = e->next;
+    }
+    return e;
+}
+
+static int demux_insert(in_addr_t ip, unsigned short remote_port, unsigned short local_port,
+                        struct sockaddr_in* udp_addr, int socket)
+{
+    unsigned int h = demux_hash(ip, remote_port, local_port);
+
+    pthread_rwlock_wrlock(&demux_lock);
+    struct demux_entry* e = demux_find(ip, remote_port, local_port);
+    if(e == NULL) {
+        e = malloc(sizeof(struct demux_entry));
+        e->ip = ip;
+        e->remote_port = remote_port;
+        e->local_port = local_port;
+        e->next = demux_table[h];
+        demux_table[h] = e;
+    }
+    e->udp_addr = *udp_addr;
+    e->socket = socket;
+    pthread_rwlock_unlock(&demux_lock);
+
+    return 0;
+}
+
+int demux_listen(unsigned short local_port, int socket)
+{
+    return demux_insert(0, 0, local_port, &remote_addr, socket);
+}
+
+int demux_add(mic_tcp_sock_addr remote, unsigned short local_port, int socket)
+{
+    in_addr_t ip = resolve(remote.ip_addr);
+    struct sockaddr_in udp_addr;
+
+    if(ip == 0) return -1;
+
+    if(last_src.sin_addr.s_addr == ip) {
+        /* Registered while handling the peer's datagram: answer there */
+        udp_addr = last_src;
+    } else {
+        /* Otherwise, the peer is a server core */
+        udp_addr = remote_addr;
+        udp_addr.sin_addr.s_addr = ip;
+    }
+
+    return demux_insert(ip, remote.port, local_port, &udp_addr, socket);
+}
+
+void demux_remove(mic_tcp_sock_addr remote, unsigned short local_port)
+{
+    in_addr_t ip = resolve(remote.ip_addr);
+    struct demux_entry** p = &demux_table[demux_hash(ip, remote.port, local_port)];
+
+    pthread_rwlock_wrlock(&demux_lock);
+    while(*p != NULL) {
+        struct demux_entry* e = *p;
+        if(e->ip == ip && e->remote_port == remote.port && e->local_port == local_port) {
+            *p = e->next;
+            free(e);
+            break;
+        }
+        p = &e->next;
+    }
+    pthread_rwlock_unlock(&demux_lock);
+}
+
+int demux_lookup(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr)
+{
+    in_addr_t ip = resolve(addr->ip_addr);
+    int socket = -1;
+
+    pthread_rwlock_rdlock(&demux_lock);
+    struct demux_entry* e = demux_find(ip, pk->header.source_port, pk->header.dest_port);
+    if(e == NULL) {
+        /* New connection for a listening socket ? */
+        e = demux_find(0, 0, pk->header.dest_port);
+    }
+    if(e != NULL) {
+        socket = e->socket;
+    }
+    pthread_rwlock_unlock(&demux_lock);
+
+    return socket;
+}
+
+int demux_udp_addr(mic_tcp_sock_addr remote, unsigned short local_port, struct sockaddr_in* udp_addr)
+{
+    in_addr_t ip = resolve(remote.ip_addr);
+    int result = -1;
+
+    if(ip == 0) return -1;
+
+    pthread_rwlock_rdlock(&demux_lock);
+    struct demux_entry* e = demux_find(ip, remote.port, local_port);
+    if(e != NULL) {
+        *udp_addr = e->udp_addr;
+        result = 0;
+    }
+    pthread_rwlock_unlock(&demux_lock);
+
+    return result;
+}
+
 
 void set_loss_rate(unsigned short rate)
 {
-    loss_rate = rate;
+    mic_tcp_impairment imp;
+
+    /* Uniform loss: both Gilbert-Elliott states lose at the same rate */
+    impair_get(&imp);
+    imp.loss_good = rate;
+    imp.loss_bad = rate;
+    imp.good_to_bad = 0;
+    imp.bad_to_good = 0;
+    impair_set(&imp);
+}
+
+int set_loss_trace(const char* path)
+{
+    /* NULL goes back to the loss and delay models */
+    return impair_load_trace(path);
+}
+
+void set_impairment(const mic_tcp_impairment* imp)
+{
+    impair_set(imp);
+}
+
+void set_bottleneck(const mic_tcp_bottleneck* link)
+{
+    impair_set_bottleneck(link);
+}
+
+void get_impairment_stats(mic_tcp_impair_stats* stats)
+{
+    impair_stats(stats);
+}
+
+int set_stats_dump(const char* path, unsigned long interval_msec)
+{
+    return stats_dump(path, interval_msec);
+}
+
+int set_congestion_control(const char* algorithm)
+{
+    return cc_set_default(algorithm);
+}
+
+int set_cwnd_trace(const char* path)
+{
+    return cc_trace(path);
+}
+
+void set_sack(int enabled)
+{
+    sack = (enabled != 0);
+}
+
+int get_sack()
+{
+    return sack;
+}
+
+void set_dupack_threshold(unsigned short threshold)
+{
+    dupack_threshold = threshold;
+}
+
+unsigned short get_dupack_threshold()
+{
+    return dupack_threshold;
+}
+
+void set_ack_delay(unsigned long delay_usec)
+{
+    ack_delay = delay_usec;
+}
+
+unsigned long get_ack_delay()
+{
+    return ack_delay;
+}
+
+void set_reorder_hold(unsigned long hold_usec)
+{
+    reorder_hold = hold_usec;
+}
+
+unsigned long get_reorder_hold()
+{
+    return reorder_hold;
+}
+
+void set_batch_size(unsigned short size)
+{
+    batch_size = (size < 1) ? 1 : (size > MAX_BATCH) ? MAX_BATCH : size;
 }
 
 void print_header(mic_tcp_pdu bf)
@@ -335,6 +957,8 @@ unsigned long get_now_time_msec()
 
 unsigned long get_now_time_usec()
 {
+    if(sim_enabled()) return sim_now();
+
     struct timespec now_time;
     clock_gettime( CLOCK_REALTIME, &now_time);
     return ((unsigned long)((now_time.tv_nsec / 1000) + (now_time.tv_sec * 1000000)));
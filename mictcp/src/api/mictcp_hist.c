@@ -0,0 +1,70 @@
+#include <api/mictcp_hist.h>
+
+static int bucket_of(unsigned long value)
+{
+    if(value < (1UL << HIST_SUB_BITS)) return value;
+    if(value >= (1UL << HIST_MAX_BITS)) return HIST_BUCKETS - 1;
+
+    int shift = (63 - __builtin_clzl(value)) - HIST_SUB_BITS + 1;
+    return shift * HIST_HALF + (value >> shift);
+}
+
+/* Largest value counted in the bucket */
+static unsigned long highest_of(int bucket)
+{
+    if(bucket < (1 << HIST_SUB_BITS)) return bucket;
+
+    int shift = bucket / HIST_HALF - 1;
+    unsigned long sub = bucket - shift * HIST_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+void hist_reset(mic_tcp_hist* h)
+{
+    for(int i = 0; i < HIST_BUCKETS; i++) {
+        __atomic_store_n(&h->buckets[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+}
+
+void hist_record(mic_tcp_hist* h, unsigned long value)
+{
+    __atomic_add_fetch(&h->buckets[bucket_of(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+
+    unsigned long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while(value > max
+          && !__atomic_compare_exchange_n(&h->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Smallest value that percent % of the recorded values do not exceed, to the
+ * width of its bucket; 0 if nothing was recorded
+ */
+unsigned long hist_percentile(mic_tcp_hist* h, double percent)
+{
+    unsigned long count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    unsigned long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    unsigned long seen = 0;
+
+    if(count == 0) return 0;
+
+    unsigned long rank = (unsigned long) (percent / 100 * count + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > count) rank = count;
+
+    for(int i = 0; i < HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if(seen >= rank) {
+            unsigned long value = highest_of(i);
+            return (value < max) ? value : max;
+        }
+    }
+    return max;
+}
+
+unsigned long hist_max(mic_tcp_hist* h)
+{
+    return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,494 @@
+#include <api/mictcp_impair.h>
+#include <api/mictcp_sim.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+/* A delayed datagram */
+struct impair_entry {
+    unsigned long due;          /* monotonic time of delivery, in µs */
+    unsigned long order;        /* keeps datagrams due together in sending order */
+    struct sockaddr_in dest;
+    int size;
+    char data[];
+};
+
+/* One recorded datagram of a loss and delay trace */
+struct trace_entry {
+    int dropped;
+    unsigned long delay_usec;
+};
+
+/* Written by impair_set from any thread: the sending threads take a copy under config_lock */
+static pthread_rwlock_t config_lock = PTHREAD_RWLOCK_INITIALIZER;
+static mic_tcp_impairment config = {0, 0, 0, 0, 0, 0, 0, 0, 1};
+static unsigned int generation = 0;     /* bumped by impair_set, reseeds the generators */
+static mic_tcp_impair_stats stats;
+
+/* Trace replayed instead of the loss and delay models, NULL when there is none */
+static struct trace_entry* trace = NULL;
+static unsigned long trace_length = 0;
+
+/*
+ * Bottleneck link, one per direction: the process sends through its own link,
+ * and on the simulated network each end through its own, so that the acks of
+ * the server never queue behind the data of the client. The sending threads of
+ * an end share its link. Each datagram leaves the link when the previous one
+ * has left and the token bucket holds its size; departures keeps the datagrams
+ * still in the queue.
+ */
+#define IMPAIR_LINKS 2
+
+struct link {
+    unsigned long last_departure;   /* µs, monotonic */
+    double tokens;                  /* bytes available after the last departure */
+    double red_average;             /* RED average queue, in bytes */
+    unsigned long queue_bytes;      /* current occupancy */
+    struct { unsigned long departure; int size; } departures[IMPAIR_MAX_QUEUE];
+    int departures_head;
+    int departures_count;
+};
+
+static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static mic_tcp_bottleneck link_config = {0, 0, 0, 0, 0, 0, 0, 0};
+static struct link links[IMPAIR_LINKS];
+
+#define RED_WEIGHT 0.002
+
+/* Per-thread generator and Gilbert-Elliott state */
+static unsigned int thread_count = 0;
+static __thread unsigned long rng_state = 0;
+static __thread unsigned int rng_generation = (unsigned int) -1;
+static __thread unsigned int rng_thread;
+static __thread int bad_state = 0;
+static __thread unsigned long trace_position = 0;  /* each sending thread replays from the start */
+
+/* Delivery thread: binary min-heap on (due, order) */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t heap_cond;
+static pthread_once_t delivery_once = PTHREAD_ONCE_INIT;
+static struct impair_entry* heap[IMPAIR_MAX_QUEUE];
+static int heap_size = 0;
+static unsigned long heap_order = 0;
+static int delivery_fd = -1;
+
+static unsigned long monotonic_usec()
+{
+    if(sim_enabled()) return sim_now();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+/* Reseeds the thread's generator and restarts its trace after impair_set or impair_load_trace */
+static void sync_thread()
+{
+    unsigned int current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+
+    if(rng_generation != current) {
+        if(rng_generation == (unsigned int) -1) {
+            rng_thread = __atomic_fetch_add(&thread_count, 1, __ATOMIC_RELAXED);
+        }
+        pthread_rwlock_rdlock(&config_lock);
+        unsigned long z = ((unsigned long) config.seed << 32) + rng_thread + 0x9E3779B97F4A7C15UL;
+        pthread_rwlock_unlock(&config_lock);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+        rng_state = (z ^ (z >> 31)) | 1;
+        rng_generation = current;
+        bad_state = 0;
+        trace_position = 0;
+    }
+}
+
+/* xorshift64*, seeded with splitmix64 from the configured seed and the thread rank */
+unsigned long impair_random()
+{
+    sync_thread();
+
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DUL;
+}
+
+/* True with the given chance, in percent */
+static int draw(float percent)
+{
+    if(percent <= 0) return 0;
+    if(percent >= 100) return 1;
+    return (impair_random() >> 11) * (100.0 / 9007199254740992.0) < percent;
+}
+
+void impair_set(const mic_tcp_impairment* c)
+{
+    pthread_rwlock_wrlock(&config_lock);
+    config = *c;
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(&config_lock);
+}
+
+void impair_get(mic_tcp_impairment* c)
+{
+    pthread_rwlock_rdlock(&config_lock);
+    *c = config;
+    pthread_rwlock_unlock(&config_lock);
+}
+
+/*
+ * Trace file: one datagram per line, "dropped delay_us", where dropped is 0 or 1
+ * and delay_us the one-way delay given to a datagram that got through.
+ * Empty lines, lines starting with '#' and a "dropped delay_us" header are skipped.
+ * Every sending thread replays the trace from its first line, in its own sending
+ * order, so that a run does not depend on how the threads interleave.
+ */
+int impair_load_trace(const char* path)
+{
+    struct trace_entry* loaded = NULL;
+    unsigned long length = 0;
+    unsigned long capacity = 0;
+
+    if(path != NULL) {
+        FILE* f = fopen(path, "r");
+        char line[256];
+        int number = 0;
+
+        if(f == NULL) {
+            perror(path);
+            return -1;
+        }
+        while(fgets(line, sizeof(line), f) != NULL) {
+            int dropped;
+            unsigned long delay;
+            char* start = line + strspn(line, " \t");
+
+            number++;
+            if(*start == '#' || *start == '\n' || *start == '\0') continue;
+            if(strncmp(start, "dropped", 7) == 0) continue;
+            if(sscanf(start, "%d %lu", &dropped, &delay) != 2 || (dropped != 0 && dropped != 1)) {
+                fprintf(stderr, "%s:%d: expected \"dropped delay_us\"\n", path, number);
+                fclose(f);
+                free(loaded);
+                return -1;
+            }
+            if(length == capacity) {
+                capacity = (capacity == 0) ? 1024 : capacity * 2;
+                struct trace_entry* grown = realloc(loaded, capacity * sizeof(*loaded));
+                if(grown == NULL) {
+                    fclose(f);
+                    free(loaded);
+                    return -1;
+                }
+                loaded = grown;
+            }
+            loaded[length].dropped = dropped;
+            loaded[length].delay_usec = delay;
+            length++;
+        }
+        fclose(f);
+        if(length == 0) {
+            fprintf(stderr, "%s: empty trace\n", path);
+            free(loaded);
+            return -1;
+        }
+    }
+
+    /* Meant to be called before sending: the previous trace is freed right away */
+    free(trace);
+    trace_length = length;
+    trace = loaded;
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void impair_set_bottleneck(const mic_tcp_bottleneck* b)
+{
+    pthread_mutex_lock(&link_lock);
+    link_config = *b;
+    for(int i = 0; i < IMPAIR_LINKS; i++) {
+        links[i].last_departure = 0;
+        links[i].tokens = b->burst_bytes;
+        links[i].red_average = 0;
+        links[i].queue_bytes = 0;
+        links[i].departures_head = 0;
+        links[i].departures_count = 0;
+    }
+    pthread_mutex_unlock(&link_lock);
+}
+
+/* Must be called with link_lock held */
+static int red_drop(struct link* l)
+{
+    l->red_average += RED_WEIGHT * (l->queue_bytes - l->red_average);
+
+    if(l->red_average < link_config.red_min) return 0;
+    if(l->red_average >= link_config.red_max) return 1;
+    return draw(link_config.red_max_p * (l->red_average - link_config.red_min) / (link_config.red_max - link_config.red_min));
+}
+
+/*
+ * Passage through the bottleneck: returns the delay until the datagram has crossed
+ * the link and the propagation delay, or -1 if the queue drops it
+ */
+static long bottleneck(int size)
+{
+    long delay;
+
+    pthread_mutex_lock(&link_lock);
+    if(link_config.rate_bps == 0) {
+        pthread_mutex_unlock(&link_lock);
+        return 0;
+    }
+
+    unsigned long now = monotonic_usec();
+    struct link* l = &links[sim_enabled() ? sim_side() : 0];
+
+    /* Datagrams already gone leave the queue */
+    while(l->departures_count > 0 && l->departures[l->departures_head].departure <= now) {
+        l->queue_bytes -= l->departures[l->departures_head].size;
+        l->departures_head = (l->departures_head + 1) % IMPAIR_MAX_QUEUE;
+        l->departures_count--;
+    }
+
+    int full = l->queue_bytes + size > link_config.queue_bytes || l->departures_count == IMPAIR_MAX_QUEUE;
+    if(full || (link_config.red && red_drop(l))) {
+        if(full) stats.queue_drops++;
+        else stats.red_drops++;
+        pthread_mutex_unlock(&link_lock);
+        return -1;
+    }
+
+    /* Token bucket: refill since the last departure, then wait for the missing tokens */
+    double rate = link_config.rate_bps / 8e6;     /* bytes per µs */
+    unsigned long start = (now > l->last_departure) ? now : l->last_departure;
+    double tokens = l->tokens + rate * (start - l->last_departure);
+    if(tokens > link_config.burst_bytes) tokens = link_config.burst_bytes;
+
+    unsigned long departure = start;
+    if(tokens >= size) {
+        l->tokens = tokens - size;
+    } else {
+        departure += (unsigned long) ((size - tokens) / rate + 0.5);
+        l->tokens = 0;
+    }
+    l->last_departure = departure;
+
+    int tail = (l->departures_head + l->departures_count) % IMPAIR_MAX_QUEUE;
+    l->departures[tail].departure = departure;
+    l->departures[tail].size = size;
+    l->departures_count++;
+    l->queue_bytes += size;
+    if(l->queue_bytes > stats.queue_max_bytes) stats.queue_max_bytes = l->queue_bytes;
+    stats.forwarded++;
+
+    delay = departure - now + link_config.propagation_usec;
+    pthread_mutex_unlock(&link_lock);
+
+    return delay;
+}
+
+void impair_stats(mic_tcp_impair_stats* s)
+{
+    s->sent = __atomic_load_n(&stats.sent, __ATOMIC_RELAXED);
+    s->lost = __atomic_load_n(&stats.lost, __ATOMIC_RELAXED);
+    s->duplicated = __atomic_load_n(&stats.duplicated, __ATOMIC_RELAXED);
+    s->delayed = __atomic_load_n(&stats.delayed, __ATOMIC_RELAXED);
+    s->reordered = __atomic_load_n(&stats.reordered, __ATOMIC_RELAXED);
+    s->replayed = __atomic_load_n(&stats.replayed, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&link_lock);
+    s->queue_bytes = 0;
+    for(int i = 0; i < IMPAIR_LINKS; i++) s->queue_bytes += links[i].queue_bytes;
+    s->queue_max_bytes = stats.queue_max_bytes;
+    s->queue_drops = stats.queue_drops;
+    s->red_drops = stats.red_drops;
+    s->forwarded = stats.forwarded;
+    pthread_mutex_unlock(&link_lock);
+}
+
+/*
+ * Fate of a datagram of size bytes: returns the number of copies to send (0 if lost),
+ * and the delay of each of them in delays
+ */
+int impair_packet(int size, unsigned long delays[IMPAIR_MAX_COPIES])
+{
+    int copies = 1;
+    int kept = 0;
+
+    const struct trace_entry* recorded = NULL;
+    mic_tcp_impairment current;
+
+    /* The whole datagram is decided on one configuration, even if impair_set runs meanwhile */
+    impair_get(&current);
+    __atomic_add_fetch(&stats.sent, 1, __ATOMIC_RELAXED);
+
+    if(trace != NULL) {
+        /* The trace decides loss and delay; it wraps around when exhausted */
+        sync_thread();
+        recorded = &trace[trace_position++ % trace_length];
+        __atomic_add_fetch(&stats.replayed, 1, __ATOMIC_RELAXED);
+        if(recorded->dropped) {
+            __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    } else {
+        /* Gilbert-Elliott: move between states, then lose with the state's rate */
+        if(bad_state ? draw(current.bad_to_good) : draw(current.good_to_bad)) {
+            bad_state = !bad_state;
+        }
+        if(draw(bad_state ? current.loss_bad : current.loss_good)) {
+            __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    if(draw(current.duplicate)) {
+        __atomic_add_fetch(&stats.duplicated, 1, __ATOMIC_RELAXED);
+        copies = 2;
+    }
+
+    for(int i = 0; i < copies; i++) {
+        unsigned long delay;
+        if(recorded != NULL) {
+            delay = recorded->delay_usec;
+        } else {
+            delay = current.delay_usec;
+            if(current.jitter_usec > 0) {
+                delay += impair_random() % (current.jitter_usec + 1);
+            }
+            if(delay > 0 && draw(current.reorder)) {
+                __atomic_add_fetch(&stats.reordered, 1, __ATOMIC_RELAXED);
+                delay = 0;
+            }
+        }
+
+        /* The link comes after the rest: its queue sees the datagrams that were not lost */
+        long link_delay = bottleneck(size);
+        if(link_delay == -1) continue;
+        delay += link_delay;
+
+        if(delay > 0) {
+            __atomic_add_fetch(&stats.delayed, 1, __ATOMIC_RELAXED);
+        }
+        delays[kept++] = delay;
+    }
+
+    return kept;
+}
+
+static int before(struct impair_entry* a, struct impair_entry* b)
+{
+    return a->due < b->due || (a->due == b->due && a->order < b->order);
+}
+
+static void heap_push(struct impair_entry* e)
+{
+    int i = heap_size++;
+
+    while(i > 0 && before(e, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = e;
+}
+
+static struct impair_entry* heap_pop()
+{
+    struct impair_entry* top = heap[0];
+    struct impair_entry* last = heap[--heap_size];
+    int i = 0;
+
+    while(2 * i + 1 < heap_size) {
+        int child = 2 * i + 1;
+        if(child + 1 < heap_size && before(heap[child + 1], heap[child])) child++;
+        if(!before(heap[child], last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+
+    return top;
+}
+
+/* Sends every datagram when it falls due */
+static void* delivery(void* arg)
+{
+    pthread_mutex_lock(&heap_lock);
+    while(1) {
+        if(heap_size == 0) {
+            pthread_cond_wait(&heap_cond, &heap_lock);
+            continue;
+        }
+
+        unsigned long now = monotonic_usec();
+        if(heap[0]->due > now) {
+            struct timespec ts = {heap[0]->due / 1000000, (heap[0]->due % 1000000) * 1000};
+            pthread_cond_timedwait(&heap_cond, &heap_lock, &ts);
+            continue;
+        }
+
+        struct impair_entry* e = heap_pop();
+        pthread_mutex_unlock(&heap_lock);
+
+        sendto(delivery_fd, e->data, e->size, 0, (struct sockaddr*) &e->dest, sizeof(e->dest));
+        free(e);
+
+        pthread_mutex_lock(&heap_lock);
+    }
+    return NULL;
+}
+
+static void start_delivery()
+{
+    pthread_condattr_t attr;
+    pthread_t th;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&heap_cond, &attr);
+    pthread_create(&th, NULL, delivery, NULL);
+    pthread_detach(th);
+}
+
+/*
+ * Hands a copy of the datagram to the delivery thread
+ * Returns 0, or -1 if too many datagrams are already waiting or no memory is left (the datagram is then lost)
+ */
+int impair_schedule(int fd, const void* header, int header_size, const void* data, int data_size,
+                    const struct sockaddr_in* dest, unsigned long delay_usec)
+{
+    pthread_once(&delivery_once, start_delivery);
+
+    struct impair_entry* e = malloc(sizeof(struct impair_entry) + header_size + data_size);
+    if(e == NULL) {
+        __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    e->due = monotonic_usec() + delay_usec;
+    e->dest = *dest;
+    e->size = header_size + data_size;
+    memcpy(e->data, header, header_size);
+    if(data_size > 0) memcpy(e->data + header_size, data, data_size);
+
+    pthread_mutex_lock(&heap_lock);
+    if(heap_size == IMPAIR_MAX_QUEUE) {
+        pthread_mutex_unlock(&heap_lock);
+        free(e);
+        __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    delivery_fd = fd;
+    e->order = heap_order++;
+    heap_push(e);
+    /* Only a new earliest datagram changes the delivery thread's deadline */
+    if(heap[0] == e) {
+        pthread_cond_signal(&heap_cond);
+    }
+    pthread_mutex_unlock(&heap_lock);
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <api/mictcp_log.h>
+#include <api/mictcp_futex.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Many producers, one consumer at a time. A slot at position pos is free when
+ * its sequence is pos, and holds a message when it is pos + 1; the consumer
+ * gives it back for the next lap with pos + LOG_CAPACITY (as the rings of
+ * mictcp_shm.c).
+ */
+typedef struct log_slot
+{
+  unsigned long seq;
+  int size;
+  char text[LOG_SLOT_SIZE];
+} log_slot;
+
+static log_slot slots[LOG_CAPACITY];
+static unsigned long tail = 0;          /* next position written, claimed by the producers */
+static unsigned long head = 0;          /* next position read, under drain_lock */
+static int sleeping = 0;                /* futex word: 1 while the drain thread waits */
+static unsigned long dropped = 0;       /* messages lost to a full ring */
+
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static int direct = 0;                  /* no drain thread: each message is written by its caller */
+
+/* Writes out what the ring holds, returns the number of messages. Called with drain_lock held */
+static int drain()
+{
+    int count = 0;
+
+    while(1) {
+        log_slot* slot = &slots[head & (LOG_CAPACITY - 1)];
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1) break;
+
+        fwrite(slot->text, 1, slot->size, stdout);
+        __atomic_store_n(&slot->seq, head + LOG_CAPACITY, __ATOMIC_RELEASE);
+        __atomic_store_n(&head, head + 1, __ATOMIC_RELAXED);
+        count++;
+    }
+
+    unsigned long lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if(lost > 0) {
+        printf("[MICTCP-LOG] %lu messages perdus (journal plein)\n", lost);
+    }
+    if(count > 0 || lost > 0) fflush(stdout);
+    return count;
+}
+
+static void* draining(void* arg)
+{
+    while(1) {
+        pthread_mutex_lock(&drain_lock);
+        int count = drain();
+        pthread_mutex_unlock(&drain_lock);
+        if(count > 0) continue;
+
+        /* Sleep, unless a message was published in between (pairs with log_write) */
+        __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+        unsigned long next = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if(__atomic_load_n(&slots[next & (LOG_CAPACITY - 1)].seq, __ATOMIC_SEQ_CST) == next + 1) {
+            __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        futex_wait(&sleeping, 1);
+    }
+    return NULL;
+}
+
+static void log_start()
+{
+    pthread_t drain_th;
+
+    for(unsigned long i = 0; i < LOG_CAPACITY; i++) {
+        slots[i].seq = i;
+    }
+    if(pthread_create(&drain_th, NULL, draining, NULL) != 0) {
+        direct = 1;
+        return;
+    }
+    pthread_detach(drain_th);
+    atexit(log_flush);
+}
+
+/* What is still in the ring, at exit or before the program stops on purpose */
+void log_flush()
+{
+    pthread_mutex_lock(&drain_lock);
+    drain();
+    pthread_mutex_unlock(&drain_lock);
+}
+
+void log_write(int level, const char* format, ...)
+{
+    va_list args;
+
+    if(level <= LOG_LEVEL_WARN) {
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fputc('\n', stderr);
+        return;
+    }
+
+    pthread_once(&log_once, log_start);
+    if(direct) {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        putchar('\n');
+        return;
+    }
+
+    /* Claim a position */
+    unsigned long pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    log_slot* slot;
+    while(1) {
+        slot = &slots[pos & (LOG_CAPACITY - 1)];
+        long gap = (long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if(gap == 0) {
+            if(__atomic_compare_exchange_n(&tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if(gap < 0) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    va_start(args, format);
+    int size = vsnprintf(slot->text, LOG_SLOT_SIZE - 1, format, args);
+    va_end(args);
+    if(size < 0) size = 0;
+    if(size > LOG_SLOT_SIZE - 2) size = LOG_SLOT_SIZE - 2;
+    slot->text[size++] = '\n';
+    slot->size = size;
+
+    /* Publish the slot, then look for a sleeping drain thread */
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+        futex_wake(&sleeping);
+    }
+}
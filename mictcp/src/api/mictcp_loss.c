@@ -0,0 +1,52 @@
+#include <api/mictcp_loss.h>
+#include <string.h>
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+static int get_bit(loss_budget* b, int i)
+{
+    return (b->lost[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+}
+
+/*
+ * percent of the window may be lost, rounded down: 0 means full reliability.
+ * Below 100/window percent that would allow no loss at all, so the window
+ * then grows to ceil(100/percent) messages, where exactly one loss fits.
+ * The window starts filled with delivered messages.
+ */
+void loss_budget_init(loss_budget* b, unsigned short percent, int window)
+{
+    if(percent > 100) percent = 100;
+    if(percent > 0 && window < (100 + percent - 1) / percent) window = (100 + percent - 1) / percent;
+    if(window < 1) window = 1;
+    if(window > LOSS_BUDGET_MAX_WINDOW) window = LOSS_BUDGET_MAX_WINDOW;
+
+    memset(b->lost, 0, sizeof(b->lost));
+    b->window = window;
+    b->allowed = (percent * window) / 100;
+    b->pos = 0;
+    b->nb_lost = 0;
+}
+
+/* Would losing the current message keep the last n messages within budget ? */
+int loss_budget_allows(loss_budget* b)
+{
+    return b->nb_lost - get_bit(b, b->pos) + 1 <= b->allowed;
+}
+
+/* Record the outcome of a message, pushing the oldest one out of the window */
+void loss_budget_record(loss_budget* b, int lost)
+{
+    unsigned long mask = 1UL << (b->pos % BITS_PER_WORD);
+    unsigned long* word = &b->lost[b->pos / BITS_PER_WORD];
+
+    b->nb_lost -= get_bit(b, b->pos);
+    if(lost) {
+        *word |= mask;
+        b->nb_lost++;
+    } else {
+        *word &= ~mask;
+    }
+
+    if(++b->pos == b->window) b->pos = 0;
+}
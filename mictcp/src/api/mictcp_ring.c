@@ -0,0 +1,83 @@
+#include <api/mictcp_ring.h>
+#include <api/mictcp_futex.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The capacity is rounded up to a power of two so that indexes wrap with a mask */
+int ring_init(mic_tcp_ring* r, unsigned int capacity)
+{
+    unsigned int c = 1;
+
+    if(capacity < 1) capacity = 1;
+    if(capacity > RING_MAX_CAPACITY) capacity = RING_MAX_CAPACITY;
+    while(c < capacity) c <<= 1;
+
+    r->slots = malloc(c * sizeof(ring_slot));
+    if(r->slots == NULL) return -1;
+    r->capacity = c;
+    r->head = 0;
+    r->tail = 0;
+    r->sleeping = 0;
+
+    return 0;
+}
+
+void ring_destroy(mic_tcp_ring* r)
+{
+    free(r->slots);
+    r->slots = NULL;
+    r->capacity = 0;
+}
+
+/* Producer side. Returns -1 if the ring is full: the message is not stored */
+int ring_put(mic_tcp_ring* r, const char* data, int size, unsigned int timestamp)
+{
+    unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    if(r->tail - head == r->capacity) return -1;
+
+    ring_slot* slot = &r->slots[r->tail & (r->capacity - 1)];
+    if(size > RING_SLOT_SIZE) size = RING_SLOT_SIZE;
+    slot->size = size;
+    slot->timestamp = timestamp;
+    memcpy(slot->data, data, size);
+
+    /* Publish the slot, then look for a sleeping consumer (pairs with ring_get) */
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+        futex_wake(&r->sleeping);
+    }
+
+    return 0;
+}
+
+/* Consumer side. Waits for a message and copies at most max_size bytes of it, and its timestamp if asked */
+int ring_get(mic_tcp_ring* r, char* data, int max_size, unsigned int* timestamp)
+{
+    while(__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+        /* Announce the sleep, then check again so that no put goes unnoticed */
+        __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) != r->head) {
+            __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+            break;
+        }
+        futex_wait(&r->sleeping, 1);
+    }
+
+    ring_slot* slot = &r->slots[r->head & (r->capacity - 1)];
+    int result = (slot->size < max_size) ? slot->size : max_size;
+    memcpy(data, slot->data, result);
+    if(timestamp != NULL) *timestamp = slot->timestamp;
+
+    /* Hand the slot back to the producer */
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+
+    return result;
+}
+
+/* Free slots as seen from the producer */
+unsigned int ring_free_slots(mic_tcp_ring* r)
+{
+    return r->capacity - (r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+}
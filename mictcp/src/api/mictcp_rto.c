@@ -0,0 +1,70 @@
+#include <api/mictcp_rto.h>
+
+static unsigned long rto_clamp(long rto)
+{
+    if(rto < RTO_MIN) return RTO_MIN;
+    if(rto > RTO_MAX) return RTO_MAX;
+    return rto;
+}
+
+void rto_init(mic_tcp_rto* e)
+{
+    e->srtt = -1;
+    e->rttvar = 0;
+    e->rto = RTO_INITIAL;
+    e->backoff = 0;
+}
+
+/*
+ * On a steady path RTTVAR falls to nothing and the timer to SRTT: a queue
+ * building up at a bottleneck would then expire it before RTTVAR follows,
+ * hence a floor proportional to SRTT.
+ */
+static void rto_compute(mic_tcp_rto* e)
+{
+    long var = (4 * e->rttvar > RTO_GRANULARITY) ? 4 * e->rttvar : RTO_GRANULARITY;
+    if(var < e->srtt / RTO_MIN_VARIATION) var = e->srtt / RTO_MIN_VARIATION;
+    e->rto = rto_clamp(e->srtt + var);
+}
+
+/*
+ * Called when a PDU is acknowledged, rtt being the time since its last
+ * transmission. Following Karn's rule, the measurement is only used if the
+ * PDU was sent exactly once, and the backoff is kept until then: otherwise a
+ * timer below the RTT would expire for every PDU, each ACK answering the
+ * previous copy and cancelling the backoff.
+ */
+void rto_ack(mic_tcp_rto* e, unsigned long rtt, int retransmitted)
+{
+    long r = (long) rtt;
+
+    /* Ambiguous sample */
+    if(retransmitted) return;
+
+    e->backoff = 0;
+
+    if(e->srtt < 0) {
+        /* First measurement */
+        e->srtt = r;
+        e->rttvar = r / 2;
+    } else {
+        /* RTTVAR <- 3/4 RTTVAR + 1/4 |SRTT - R'|, SRTT <- 7/8 SRTT + 1/8 R' */
+        long delta = e->srtt - r;
+        if(delta < 0) delta = -delta;
+        e->rttvar = (3 * e->rttvar + delta) / 4;
+        e->srtt = (7 * e->srtt + r) / 8;
+    }
+
+    rto_compute(e);
+}
+
+/* Called on each timer expiry: the timeout doubles until the next ACK */
+void rto_backoff(mic_tcp_rto* e)
+{
+    if(e->backoff < RTO_MAX_BACKOFF) e->backoff++;
+}
+
+unsigned long rto_get(mic_tcp_rto* e)
+{
+    return rto_clamp(e->rto << e->backoff);
+}
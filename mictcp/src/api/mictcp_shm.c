@@ -0,0 +1,214 @@
+#include <api/mictcp_shm.h>
+#include <api/mictcp_futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static size_t segment_size()
+{
+    return sizeof(shm_ring) + SHM_RING_CAPACITY * sizeof(shm_slot);
+}
+
+static shm_ring* map(unsigned short port, int flags)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SHM_NAME, port);
+
+    int fd = shm_open(name, flags, 0600);
+    if(fd == -1) return NULL;
+    if((flags & O_CREAT) && ftruncate(fd, segment_size()) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    shm_ring* r = mmap(NULL, segment_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (r == MAP_FAILED) ? NULL : r;
+}
+
+/* Inbox of this core: a segment left by a previous owner of the port is reset */
+shm_ring* shm_ring_create(unsigned short port)
+{
+    shm_ring* r = map(port, O_RDWR | O_CREAT);
+    if(r == NULL) return NULL;
+
+    r->magic = 0;
+    r->capacity = SHM_RING_CAPACITY;
+    r->sleeping = 0;
+    r->head = 0;
+    r->tail = 0;
+    for(unsigned long i = 0; i < SHM_RING_CAPACITY; i++) {
+        r->slots[i].seq = i;
+    }
+    r->owner = getpid();
+    __atomic_store_n(&r->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return r;
+}
+
+/* Inbox of the local core bound to this port, NULL if there is no live one */
+shm_ring* shm_ring_attach(unsigned short port)
+{
+    shm_ring* r = map(port, O_RDWR);
+    if(r == NULL) return NULL;
+
+    if(__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+       || (kill(r->owner, 0) == -1 && errno != EPERM)) {
+        shm_ring_detach(r);
+        return NULL;
+    }
+    return r;
+}
+
+void shm_ring_detach(shm_ring* r)
+{
+    munmap(r, segment_size());
+}
+
+void shm_ring_destroy(shm_ring* r, unsigned short port)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SHM_NAME, port);
+
+    r->magic = 0;
+    munmap(r, segment_size());
+    shm_unlink(name);
+}
+
+/*
+ * Any process, any thread. A slot at position pos is free when its sequence is
+ * pos, and holds a datagram when it is pos + 1; the consumer gives it back for
+ * the next lap with pos + capacity.
+ * Returns -1 if the ring is full: the datagram is lost, as with a full socket.
+ */
+int shm_ring_put(shm_ring* r, const struct sockaddr_in* src, const void* header, int header_size,
+                 const void* data, int data_size)
+{
+    unsigned long pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    shm_slot* slot;
+
+    if(header_size + data_size > SHM_SLOT_SIZE) return -1;
+
+    while(1) {
+        slot = &r->slots[pos & (r->capacity - 1)];
+        long gap = (long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if(gap == 0) {
+            if(__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if(gap < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->src = *src;
+    slot->size = header_size + data_size;
+    memcpy(slot->data, header, header_size);
+    if(data_size > 0) {
+        memcpy(slot->data + header_size, data, data_size);
+    }
+
+    /* Publish the slot, then look for a sleeping consumer (pairs with shm_ring_get) */
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+        futex_wake_shared(&r->sleeping);
+    }
+
+    return slot->size;
+}
+
+/* Takes the next datagram if there is one, returns its size or -1 */
+static int take(shm_ring* r, struct sockaddr_in* src, void* header, int header_size, void* data, int data_size)
+{
+    unsigned long pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    shm_slot* slot;
+
+    while(1) {
+        slot = &r->slots[pos & (r->capacity - 1)];
+        long gap = (long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+
+        if(gap == 0) {
+            if(__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if(gap < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    int size = slot->size;
+    int payload = size - header_size;
+    if(payload > data_size) payload = data_size;
+
+    if(src != NULL) *src = slot->src;
+    memcpy(header, slot->data, header_size);
+    if(payload > 0) {
+        memcpy(data, slot->data + header_size, payload);
+    }
+
+    /* Hand the slot back to the producers */
+    __atomic_store_n(&slot->seq, pos + r->capacity, __ATOMIC_RELEASE);
+
+    return header_size + ((payload > 0) ? payload : 0);
+}
+
+/*
+ * Consumer side, same contract as the socket reception: a null timeout blocks
+ * when wait is set, otherwise only collects what is already there.
+ * Returns the size of the datagram (header included), or -1.
+ */
+int shm_ring_get(shm_ring* r, struct sockaddr_in* src, void* header, int header_size,
+                 void* data, int data_size, unsigned long timeout_usec, int wait)
+{
+    struct timespec deadline;
+    int result;
+
+    if(timeout_usec > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_usec / 1000000;
+        deadline.tv_nsec += (timeout_usec % 1000000) * 1000;
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    while((result = take(r, src, header, header_size, data, data_size)) == -1) {
+        struct timespec remaining;
+        struct timespec* timeout = NULL;
+
+        if(timeout_usec > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if(remaining.tv_nsec < 0) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000;
+            }
+            if(remaining.tv_sec < 0) return -1;
+            timeout = &remaining;
+        } else if(!wait) {
+            return -1;
+        }
+
+        /* Announce the sleep, then check again so that no put goes unnoticed */
+        __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        result = take(r, src, header, header_size, data, data_size);
+        if(result != -1) {
+            __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+            break;
+        }
+        futex_wait_shared(&r->sleeping, 1, timeout);
+    }
+
+    return result;
+}
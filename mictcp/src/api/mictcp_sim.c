@@ -0,0 +1,294 @@
+#include <api/mictcp_core.h>
+#include <api/mictcp_sim.h>
+
+#define SIM_FOREVER ((unsigned long) -1)
+
+/* A datagram travelling on the simulated link */
+struct sim_datagram {
+    unsigned long due;          /* virtual date of delivery, in µs */
+    unsigned long order;        /* keeps datagrams due together in sending order */
+    unsigned short size;        /* payload size */
+    void (*expire)(int socket); /* a timer of the receiving end rather than a datagram, see sim_timer */
+    int socket;                 /* its socket */
+    char data[];                /* header, then payload */
+};
+
+/* Binary min-heap on (due, order), one per receiving end */
+struct sim_heap {
+    struct sim_datagram** items;
+    int size;
+    int capacity;
+};
+
+static int enabled = 0;
+static unsigned long clock_usec = SIM_EPOCH;
+static unsigned long order = 0;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_heap heaps[2];    /* indexed by the receiving end */
+static __thread start_mode side = CLIENT;
+static void (*advance_hook)() = NULL;
+static mic_tcp_sim_stats stats;
+
+/* The simulated cores both live on the loopback */
+static char loopback[] = "127.0.0.1";
+
+static int earlier(const struct sim_datagram* a, const struct sim_datagram* b)
+{
+    return a->due < b->due || (a->due == b->due && a->order < b->order);
+}
+
+static int heap_push(struct sim_heap* h, struct sim_datagram* d)
+{
+    if(h->size == h->capacity) {
+        int capacity = (h->capacity == 0) ? 256 : h->capacity * 2;
+        struct sim_datagram** items = realloc(h->items, capacity * sizeof(*items));
+        if(items == NULL) return -1;
+        h->items = items;
+        h->capacity = capacity;
+    }
+
+    int i = h->size++;
+    while(i > 0 && earlier(d, h->items[(i - 1) / 2])) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i] = d;
+    return 0;
+}
+
+static struct sim_datagram* heap_pop(struct sim_heap* h)
+{
+    struct sim_datagram* top = h->items[0];
+    struct sim_datagram* last = h->items[--h->size];
+    int i = 0;
+
+    while(2 * i + 1 < h->size) {
+        int child = 2 * i + 1;
+        if(child + 1 < h->size && earlier(h->items[child + 1], h->items[child])) child++;
+        if(!earlier(h->items[child], last)) break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    h->items[i] = last;
+    return top;
+}
+
+/*
+ * Next datagram due by the deadline, for the server or, when client is set,
+ * for the client; the clock moves to its date. Without one, the clock moves
+ * to the deadline and NULL is returned.
+ */
+static struct sim_datagram* next(unsigned long deadline, int client, start_mode* to)
+{
+    struct sim_datagram* d = NULL;
+    struct sim_heap* server = &heaps[SERVER];
+    struct sim_heap* own = &heaps[CLIENT];
+    int caught_up = 0;
+    int server_due, client_due;
+
+    pthread_mutex_lock(&sim_lock);
+    while(1) {
+        server_due = server->size > 0 && server->items[0]->due <= deadline;
+        client_due = client && own->size > 0 && own->items[0]->due <= deadline;
+        if(!server_due && !client_due && deadline == SIM_FOREVER) break;
+
+        *to = (client_due && (!server_due || earlier(own->items[0], server->items[0]))) ? CLIENT : SERVER;
+        unsigned long date = (server_due || client_due) ? heaps[*to].items[0]->due : deadline;
+
+        /* The applications see the present before the clock moves on (they may send) */
+        if(advance_hook == NULL || caught_up || date <= clock_usec) break;
+        pthread_mutex_unlock(&sim_lock);
+        advance_hook();
+        pthread_mutex_lock(&sim_lock);
+        caught_up = 1;
+    }
+
+    if(!server_due && !client_due) {
+        if(deadline != SIM_FOREVER && deadline > clock_usec) {
+            __atomic_store_n(&clock_usec, deadline, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&sim_lock);
+        return NULL;
+    }
+
+    d = heap_pop(&heaps[*to]);
+    if(d->due > clock_usec) {
+        __atomic_store_n(&clock_usec, d->due, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return d;
+}
+
+/* What the listening thread does with a datagram, in the calling thread */
+static void deliver(struct sim_datagram* d)
+{
+    mic_tcp_pdu pdu;
+    mic_tcp_sock_addr remote;
+    start_mode caller = side;
+
+    if(d->expire != NULL) {
+        side = SERVER;
+        d->expire(d->socket);
+        side = caller;
+        return;
+    }
+
+    memcpy(&pdu.header, d->data, API_HD_Size);
+    pdu.payload.data = d->data + API_HD_Size;
+    pdu.payload.size = d->size;
+    remote.ip_addr = loopback;
+    remote.ip_addr_size = sizeof(loopback);
+    remote.port = pdu.header.source_port;
+
+    side = SERVER;
+    process_received_PDU(pdu, remote, demux_lookup(&pdu, &remote));
+    side = caller;
+}
+
+void sim_enable()
+{
+    enabled = 1;
+}
+
+int sim_enabled()
+{
+    return enabled;
+}
+
+void sim_endpoint(start_mode end)
+{
+    side = end;
+}
+
+/* End the calling thread sends from */
+start_mode sim_side()
+{
+    return side;
+}
+
+/* Called by the thread that moves the clock, just before it does */
+void sim_on_advance(void (*hook)())
+{
+    advance_hook = hook;
+}
+
+/* Every PDU handed to the core, before the impairment stage */
+void sim_account(const mic_tcp_pdu* pk)
+{
+    __atomic_add_fetch(&stats.datagrams[side], 1, __ATOMIC_RELAXED);
+    if(pk->payload.size > 0) {
+        __atomic_add_fetch(&stats.data[side], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void sim_stats(mic_tcp_sim_stats* s)
+{
+    for(int end = CLIENT; end <= SERVER; end++) {
+        s->datagrams[end] = __atomic_load_n(&stats.datagrams[end], __ATOMIC_RELAXED);
+        s->data[end] = __atomic_load_n(&stats.data[end], __ATOMIC_RELAXED);
+    }
+}
+
+unsigned long sim_now()
+{
+    return __atomic_load_n(&clock_usec, __ATOMIC_ACQUIRE);
+}
+
+/* Lets the virtual time run without receiving, serving the server end only */
+void sim_run(unsigned long duration_usec)
+{
+    unsigned long deadline = sim_now() + duration_usec;
+    struct sim_datagram* d;
+    start_mode to;
+
+    while((d = next(deadline, 0, &to)) != NULL) {
+        deliver(d);
+        free(d);
+    }
+}
+
+int sim_send(const mic_tcp_pdu* pk, unsigned long delay_usec)
+{
+    struct sim_datagram* d = malloc(sizeof(*d) + API_HD_Size + pk->payload.size);
+    if(d == NULL) return -1;
+
+    d->size = pk->payload.size;
+    d->expire = NULL;
+    memcpy(d->data, &pk->header, API_HD_Size);
+    if(pk->payload.size > 0) {
+        memcpy(d->data + API_HD_Size, pk->payload.data, pk->payload.size);
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    d->due = clock_usec + delay_usec;
+    d->order = order++;
+    int result = heap_push(&heaps[(side == CLIENT) ? SERVER : CLIENT], d);
+    pthread_mutex_unlock(&sim_lock);
+
+    if(result == -1) free(d);
+    return result;
+}
+
+/* A timer of the calling end, due like a datagram sent to itself */
+int sim_timer(int socket, unsigned long delay_usec, void (*expire)(int socket))
+{
+    struct sim_datagram* d = malloc(sizeof(*d));
+    if(d == NULL) return -1;
+
+    d->size = 0;
+    d->expire = expire;
+    d->socket = socket;
+
+    pthread_mutex_lock(&sim_lock);
+    d->due = clock_usec + delay_usec;
+    d->order = order++;
+    int result = heap_push(&heaps[side], d);
+    pthread_mutex_unlock(&sim_lock);
+
+    if(result == -1) free(d);
+    return result;
+}
+
+/*
+ * Same contract as the socket reception: a null timeout blocks when wait is
+ * set, otherwise only collects what is already due. Blocking with nothing in
+ * flight returns -1 at once, since nothing could ever arrive.
+ * The server end receives through process_received_PDU only.
+ */
+int sim_recv(mic_tcp_pdu* pk, mic_tcp_sock_addr* addr, unsigned long timeout_usec, int wait)
+{
+    unsigned long deadline = (timeout_usec > 0) ? sim_now() + timeout_usec : wait ? SIM_FOREVER : sim_now();
+    struct sim_datagram* d;
+    start_mode to;
+
+    if(side == SERVER) return -1;
+
+    while((d = next(deadline, 1, &to)) != NULL) {
+        if(to == SERVER) {
+            deliver(d);
+            free(d);
+            continue;
+        }
+        if(d->expire != NULL) {
+            d->expire(d->socket);
+            free(d);
+            continue;
+        }
+
+        int size = min_size(d->size, (pk->payload.size > 0) ? pk->payload.size : 0);
+        memcpy(&pk->header, d->data, API_HD_Size);
+        if(size > 0) {
+            memcpy(pk->payload.data, d->data + API_HD_Size, size);
+        }
+        pk->payload.size = size;
+        if(addr != NULL) {
+            addr->ip_addr = loopback;
+            addr->ip_addr_size = sizeof(loopback);
+            addr->port = pk->header.source_port;
+        }
+        free(d);
+        return size;
+    }
+
+    return -1;
+}
@@ -0,0 +1,173 @@
+#include <api/mictcp_core.h>
+#include <api/mictcp_stats.h>
+#include <time.h>
+
+static mic_tcp_stats counters[MAX_SOCKETS];
+static mic_tcp_hist ack_latency[MAX_SOCKETS];
+static mic_tcp_hist delivery_latency[MAX_SOCKETS];
+
+/* Background dump */
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* dump_file = NULL;
+static unsigned long dump_interval = STATS_DUMP_INTERVAL;
+static int dump_started = 0;
+
+void stats_reset(int socket)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+
+    unsigned long* c = (unsigned long*) &counters[socket];
+    for(size_t i = 0; i < sizeof(mic_tcp_stats) / sizeof(unsigned long); i++) {
+        __atomic_store_n(&c[i], 0, __ATOMIC_RELAXED);
+    }
+    hist_reset(&ack_latency[socket]);
+    hist_reset(&delivery_latency[socket]);
+}
+
+/* Any thread: the reception thread and the application both count */
+void stats_add(int socket, size_t offset, unsigned long n)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+    __atomic_add_fetch((unsigned long*) ((char*) &counters[socket] + offset), n, __ATOMIC_RELAXED);
+}
+
+/* Current estimates of the retransmission timer */
+void stats_rto(int socket, mic_tcp_rto* rto)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+    __atomic_store_n(&counters[socket].rto_usec, rto_get(rto), __ATOMIC_RELAXED);
+    __atomic_store_n(&counters[socket].srtt_usec, (rto->srtt < 0) ? 0 : rto->srtt, __ATOMIC_RELAXED);
+}
+
+/* Sender: from the first sending of a message to its acknowledgement */
+void stats_ack_latency(int socket, unsigned long usec)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+    hist_record(&ack_latency[socket], usec);
+}
+
+/* Receiver: from the submission of a message by the sending application to its delivery */
+void stats_delivery_latency(int socket, unsigned long usec)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+    hist_record(&delivery_latency[socket], usec);
+}
+
+int stats_get(int socket, mic_tcp_stats* stats)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return -1;
+
+    unsigned long* from = (unsigned long*) &counters[socket];
+    unsigned long* to = (unsigned long*) stats;
+    for(size_t i = 0; i < sizeof(mic_tcp_stats) / sizeof(unsigned long); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+    stats->app_buffer_depth = app_buffer_depth(socket);
+
+    mic_tcp_hist* h = &ack_latency[socket];
+    stats->ack_latency_p50_usec = hist_percentile(h, 50);
+    stats->ack_latency_p99_usec = hist_percentile(h, 99);
+    stats->ack_latency_p999_usec = hist_percentile(h, 99.9);
+    stats->ack_latency_max_usec = hist_max(h);
+    h = &delivery_latency[socket];
+    stats->delivery_latency_p50_usec = hist_percentile(h, 50);
+    stats->delivery_latency_p99_usec = hist_percentile(h, 99);
+    stats->delivery_latency_p999_usec = hist_percentile(h, 99.9);
+    stats->delivery_latency_max_usec = hist_max(h);
+    return 0;
+}
+
+/* Called with dump_lock held */
+static void dump_socket(int socket, unsigned long now)
+{
+    mic_tcp_stats s;
+
+    if(dump_file == NULL || stats_get(socket, &s) == -1) return;
+    fprintf(dump_file, "{\"time_ms\": %lu, \"socket\": %d, \"pdu_sent\": %lu, \"pdu_received\": %lu, "
+            "\"retransmissions\": %lu, \"fast_retransmits\": %lu, \"timeouts\": %lu, \"tolerated_losses\": %lu, \"duplicates\": %lu, "
+            "\"reordered\": %lu, \"holes_skipped\": %lu, \"acks_sent\": %lu, \"sacked\": %lu, \"bytes_delivered\": %lu, \"rto_usec\": %lu, \"srtt_usec\": %lu, "
+            "\"app_buffer_depth\": %lu, "
+            "\"ack_latency_usec\": {\"p50\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}, "
+            "\"delivery_latency_usec\": {\"p50\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}}\n",
+            now, socket, s.pdu_sent, s.pdu_received, s.retransmissions, s.fast_retransmits, s.timeouts, s.tolerated_losses,
+            s.duplicates, s.reordered, s.holes_skipped, s.acks_sent, s.sacked, s.bytes_delivered, s.rto_usec, s.srtt_usec, s.app_buffer_depth,
+            s.ack_latency_p50_usec, s.ack_latency_p99_usec, s.ack_latency_p999_usec, s.ack_latency_max_usec,
+            s.delivery_latency_p50_usec, s.delivery_latency_p99_usec, s.delivery_latency_p999_usec,
+            s.delivery_latency_max_usec);
+}
+
+/* One line per socket in use */
+static void dump_round()
+{
+    unsigned long now = get_now_time_msec();
+
+    if(dump_file == NULL) return;
+    for(int socket = 0; socket < MAX_SOCKETS; socket++) {
+        if(socket_in_use(socket)) dump_socket(socket, now);
+    }
+    fflush(dump_file);
+}
+
+/* Last line of a socket being freed, so that short connections show up too */
+void stats_release(int socket)
+{
+    if(socket < 0 || socket >= MAX_SOCKETS) return;
+
+    pthread_mutex_lock(&dump_lock);
+    if(dump_file != NULL) {
+        dump_socket(socket, get_now_time_msec());
+        fflush(dump_file);
+    }
+    pthread_mutex_unlock(&dump_lock);
+}
+
+static void* dumping(void* arg)
+{
+    while(1) {
+        pthread_mutex_lock(&dump_lock);
+        unsigned long interval = dump_interval;
+        dump_round();
+        pthread_mutex_unlock(&dump_lock);
+
+        struct timespec ts = {interval / 1000, (interval % 1000) * 1000000};
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/* The counters as the program leaves, whatever the interval */
+static void dump_last()
+{
+    pthread_mutex_lock(&dump_lock);
+    dump_round();
+    pthread_mutex_unlock(&dump_lock);
+}
+
+/*
+ * Appends the counters of every socket to path each interval_msec (0: the
+ * default interval); a NULL path stops the dump.
+ */
+int stats_dump(const char* path, unsigned long interval_msec)
+{
+    FILE* file = NULL;
+
+    if(path != NULL && (file = fopen(path, "a")) == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    pthread_mutex_lock(&dump_lock);
+    if(dump_file != NULL) fclose(dump_file);
+    dump_file = file;
+    dump_interval = (interval_msec > 0) ? interval_msec : STATS_DUMP_INTERVAL;
+    if(file != NULL && !dump_started) {
+        pthread_t dump_th;
+        if(pthread_create(&dump_th, NULL, dumping, NULL) == 0) {
+            pthread_detach(dump_th);
+            atexit(dump_last);
+            dump_started = 1;
+        }
+    }
+    pthread_mutex_unlock(&dump_lock);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <api/mictcp_core.h>
+#include <api/mictcp_timer.h>
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static pthread_t timer_th;
+static unsigned long due[MAX_SOCKETS];             /* date of the call, 0: none pending */
+static void (*handler[MAX_SOCKETS])(int socket);
+
+/* Sleeps until the earliest date, then makes the call without the lock */
+static void* timing(void* arg)
+{
+    pthread_mutex_lock(&timer_lock);
+    while(1) {
+        int socket = -1;
+
+        for(int i = 0; i < MAX_SOCKETS; i++) {
+            if(due[i] != 0 && (socket == -1 || due[i] < due[socket])) socket = i;
+        }
+
+        if(socket == -1) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+        if(due[socket] > get_now_time_usec()) {
+            /* Same clock as get_now_time_usec */
+            struct timespec until = {due[socket] / 1000000, (due[socket] % 1000000) * 1000};
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &until);
+            continue;
+        }
+
+        void (*expire)(int socket) = handler[socket];
+        due[socket] = 0;
+        pthread_mutex_unlock(&timer_lock);
+        expire(socket);
+        pthread_mutex_lock(&timer_lock);
+    }
+    return NULL;
+}
+
+static void timer_start()
+{
+    pthread_create(&timer_th, NULL, timing, NULL);
+    pthread_detach(timer_th);
+}
+
+int timer_arm(int socket, unsigned long delay_usec, void (*expire)(int socket))
+{
+    if(socket < 0 || socket >= MAX_SOCKETS || expire == NULL) return -1;
+
+    /* The simulated clock only moves in its own thread: the call is an event of the link */
+    if(sim_enabled()) return sim_timer(socket, delay_usec, expire);
+
+    pthread_once(&timer_once, timer_start);
+
+    unsigned long date = get_now_time_usec() + delay_usec;
+    pthread_mutex_lock(&timer_lock);
+    if(due[socket] == 0 || date < due[socket]) {
+        due[socket] = date;
+        handler[socket] = expire;
+        pthread_cond_signal(&timer_cond);
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return 0;
+}
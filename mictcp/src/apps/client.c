@@ -23,6 +23,12 @@ int main()
         printf("[TSOCK] Creation du socket MICTCP: OK\n");
     }
 
+    /* Le texte ne supporte aucune perte */
+    if (mic_tcp_set_loss_tolerance(sockfd, 0) == -1)
+    {
+        printf("[TSOCK] Fiabilite totale non disponible pour le socket MICTCP\n");
+    }
+
     if (mic_tcp_connect(sockfd, addr) == -1)
     {
         printf("[TSOCK] Erreur a la connexion du socket MICTCP!\n");
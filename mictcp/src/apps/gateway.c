@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <mictcp.h>
+#include <api/mictcp_core.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -16,8 +17,9 @@
 //
 
 #define ENABLE_TCP_LOSS 1
-#define MAX_UDP_SEGMENT_SIZE 1480
+#define MAX_UDP_SEGMENT_SIZE (1500 - API_HD_Size) // Plus grand message tenant dans un datagramme de 1500 octets avec l'en-tête MIC-TCP
 #define MICTCP_PORT 1337
+#define MICTCP_LOSS_TOLERANCE 50    // % de pertes admissibles pour la vidéo
 #define VIDEO_FILE "../video/video.bin"
 
 /**
@@ -216,6 +218,11 @@ static void file_to_mictcp(char* filename)
         printf("ERROR creating the MICTCP socket\n");
     }
 
+    /* La vidéo supporte des pertes : on propose notre tolérance */
+    if (mic_tcp_set_loss_tolerance(sockfd, MICTCP_LOSS_TOLERANCE) == -1) {
+        printf("ERROR setting the MICTCP loss tolerance\n");
+    }
+
     /* On effectue la connexion */
     mic_tcp_sock_addr dest_addr;
     dest_addr.ip_addr = "localhost";
@@ -295,16 +302,22 @@ static void mictcp_to_udp(char *host, int port)
         printf("ERROR on binding the MICTCP socket\n");
     }
 
+    /* Tolérance maximale acceptée lors de la connexion */
+    if (mic_tcp_set_loss_tolerance(mictcp_sockfd, MICTCP_LOSS_TOLERANCE) == -1) {
+        printf("ERROR setting the MICTCP loss tolerance\n");
+    }
+
     /* Acceptation d'une demande de connexion */
     mic_tcp_sock_addr mt_remote_addr;
-    if (mic_tcp_accept(mictcp_sockfd, &mt_remote_addr) == -1) {
+    int mictcp_connfd = mic_tcp_accept(mictcp_sockfd, &mt_remote_addr);
+    if (mictcp_connfd == -1) {
         printf("ERROR on accept on the MICTCP socket\n");
     }
 
     /* Lecture mictcp vers udp */
     char buff[MAX_UDP_SEGMENT_SIZE];    // buffer de lecture/ecriture
     while (1) {
-        int nb_read = mic_tcp_recv(mictcp_sockfd, buff, MAX_UDP_SEGMENT_SIZE);
+        int nb_read = mic_tcp_recv(mictcp_connfd, buff, MAX_UDP_SEGMENT_SIZE);
         if (nb_read <= 0) {
             if (nb_read < 0) {
                 printf("ERROR on mic_recv on the MICTCP socket\n");
@@ -317,6 +330,9 @@ static void mictcp_to_udp(char *host, int port)
     }
 
     /* Fermeture des sockets */
+    if (mictcp_connfd != mictcp_sockfd && mic_tcp_close(mictcp_connfd) == -1) {
+        printf("ERROR on MICTCP close\n");
+    }
     if (mic_tcp_close(mictcp_sockfd) == -1) {
         printf("ERROR on MICTCP close\n");
     }
@@ -0,0 +1,111 @@
+/*
+ * Round-trip latency of the core between two processes of the same host.
+ *
+ * The server echoes every PDU from process_received_PDU; the client sends one
+ * PDU at a time, waits for its echo, and reports the round-trip percentiles
+ * and the CPU time of the client process per round trip. Run it with
+ * MICTCP_SHM=0 to compare the shared-memory transport with UDP loopback.
+ * No mictcp version is linked: only the core is measured.
+ *
+ * Usage: latency server
+ *        latency client [payload size] [round trips]
+ */
+#include <mictcp.h>
+#include <api/mictcp_core.h>
+#include <signal.h>
+
+static int compare(const void* a, const void* b)
+{
+    unsigned long x = *(const unsigned long*) a;
+    unsigned long y = *(const unsigned long*) b;
+    return (x > y) - (x < y);
+}
+
+/* Server side: the echo */
+void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
+{
+    IP_send(pdu, addr);
+}
+
+/* Lets the core remove its shared-memory inbox when the server is killed */
+static void quit(int sig)
+{
+    exit(0);
+}
+
+static unsigned long monotonic_nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 1 && strcmp(argv[1], "server") == 0) {
+        if(initialize_components(SERVER) == -1) {
+            fprintf(stderr, "Core initialization failed\n");
+            return 1;
+        }
+        set_loss_rate(0);
+        signal(SIGTERM, quit);
+        signal(SIGINT, quit);
+        pause();
+        return 0;
+    }
+
+    int size = (argc > 2) ? atoi(argv[2]) : 100;
+    int rounds = (argc > 3) ? atoi(argv[3]) : 100000;
+    char payload[1500];
+    char echo[1500];
+
+    if(size < 0 || size > 1500 - API_HD_Size || rounds < 1) {
+        fprintf(stderr, "Payload size must be in [0, %d]\n", 1500 - API_HD_Size);
+        return 1;
+    }
+    if(initialize_components(CLIENT) == -1) {
+        fprintf(stderr, "Core initialization failed\n");
+        return 1;
+    }
+    set_loss_rate(0);
+
+    unsigned long* samples = malloc(rounds * sizeof(unsigned long));
+    mic_tcp_sock_addr addr = {"127.0.0.1", 10, 0};
+    mic_tcp_pdu pdu, answer;
+    memset(&pdu.header, 0, sizeof(pdu.header));
+    memset(payload, 'x', sizeof(payload));
+    pdu.payload.data = payload;
+    pdu.payload.size = size;
+    answer.payload.data = echo;
+
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    int done = 0;
+    int lost = 0;
+    for(int i = 0; i < rounds; i++) {
+        pdu.header.seq_num = i;
+        unsigned long start = monotonic_nsec();
+        IP_send(pdu, addr);
+        do {
+            answer.payload.size = sizeof(echo);
+        } while(IP_recv_us(&answer, NULL, 100000) != -1 && answer.header.seq_num != (unsigned int) i);
+        if(answer.header.seq_num != (unsigned int) i) {
+            lost++;
+            continue;
+        }
+        samples[done++] = monotonic_nsec() - start;
+    }
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+    if(done == 0) {
+        fprintf(stderr, "No echo: is the latency server running ?\n");
+        return 1;
+    }
+    qsort(samples, done, sizeof(unsigned long), compare);
+    double cpu = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e6 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e3;
+    const char* shm = getenv("MICTCP_SHM");
+    printf("transport=%s payload=%d rounds=%d lost=%d rtt_us_p50=%.1f p99=%.1f max=%.1f client_cpu_us_per_rtt=%.2f\n",
+           (shm != NULL && atoi(shm) == 0) ? "udp" : "shm", size, done, lost,
+           samples[done / 2] / 1e3, samples[done * 99 / 100] / 1e3, samples[done - 1] / 1e3, cpu / done);
+    return 0;
+}
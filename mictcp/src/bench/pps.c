@@ -0,0 +1,107 @@
+/*
+ * Packets-per-second benchmark of the core send path on loopback.
+ *
+ * Sends PDUs of a given payload size with IP_send as fast as possible towards
+ * a plain UDP sink bound on the server port, and reports the rate seen by the
+ * sender and by the sink, and the process CPU time (sender and sink) per packet.
+ * No mictcp version is linked: only the core is measured.
+ *
+ * Usage: pps [payload size] [duration in s] [batch size]
+ */
+#include <mictcp.h>
+#include <api/mictcp_core.h>
+
+static volatile int running = 1;
+static volatile unsigned long received = 0;
+
+/* The core expects a mictcp version, this one is never called in CLIENT mode */
+void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
+{
+}
+
+static void* sink(void* arg)
+{
+    int fd = *(int*) arg;
+    char buffer[1500];
+    struct timeval tv = {0, 100000};
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while(running) {
+        if(recv(fd, buffer, sizeof(buffer), 0) > 0) received++;
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int size = (argc > 1) ? atoi(argv[1]) : 1000;
+    int duration = (argc > 2) ? atoi(argv[2]) : 2;
+    int batch = (argc > 3) ? atoi(argv[3]) : 1;
+    char payload[1500];
+    int rcvbuf = 8 << 20;
+
+    if(size < 0 || size > 1500 - API_HD_Size) {
+        fprintf(stderr, "Payload size must be in [0, %d]\n", 1500 - API_HD_Size);
+        return 1;
+    }
+
+    /* The sink stands for the server core */
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(API_CS_Port);
+    local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if(bind(fd, (struct sockaddr*) &local_addr, sizeof(local_addr)) == -1) {
+        perror("bind");
+        return 1;
+    }
+
+    if(initialize_components(CLIENT) == -1) {
+        fprintf(stderr, "Core initialization failed\n");
+        return 1;
+    }
+    set_loss_rate(0);
+    set_batch_size(batch);
+
+    pthread_t sink_th;
+    pthread_create(&sink_th, NULL, sink, &fd);
+
+    mic_tcp_pdu pdu;
+    memset(&pdu.header, 0, sizeof(pdu.header));
+    memset(payload, 'x', sizeof(payload));
+    pdu.payload.data = payload;
+    pdu.payload.size = size;
+
+    mic_tcp_sock_addr addr = {"127.0.0.1", 10, 0};
+
+    unsigned long sent = 0;
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    unsigned long start = get_now_time_usec();
+    unsigned long end = start + duration * 1000000UL;
+    unsigned long now = start;
+
+    while(now < end) {
+        /* Check the clock every 256 packets only */
+        IP_send_begin();
+        for(int i = 0; i < 256; i++) {
+            pdu.header.seq_num = sent;
+            if(IP_send(pdu, addr) != -1) sent++;
+        }
+        IP_send_flush();
+        now = get_now_time_usec();
+    }
+
+    usleep(200000);
+    running = 0;
+    pthread_join(sink_th, NULL);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+    double elapsed = (now - start) / 1e6;
+    double cpu = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e6 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e3;
+    printf("payload=%d batch=%d sent=%lu pps_sent=%.0f pps_received=%.0f cpu_us_per_pkt=%.2f\n",
+           size, batch, sent, sent / elapsed, received / elapsed, cpu / sent);
+    return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * Transfer benchmark of a mictcp version over the simulated link.
+ *
+ * Client and server run in this process on virtual time: the client sends
+ * a number of messages of a given size, the server application reads them,
+ * and the transfer time is the virtual time from the end of the handshake
+ * until mic_tcp_close returns. Each run is one loss/size/RTT point and takes
+ * milliseconds whatever the RTT. The output of the version goes to /dev/null,
+ * the result to the original standard output.
+ *
+ * Each message starts with its index and its virtual sending date, so that
+ * the server application measures the latency until delivery. It reads in
+ * the thread that moves the clock, from the hook of sim_on_advance (and before
+ * each message, for the versions that never wait): the server buffer is empty
+ * whenever the clock moves, and a run only depends on its parameters.
+ * A send that returns without moving the clock still occupies the interface
+ * of the client (ACCESS_KBPS): the clock then runs for the serialization time
+ * of the datagram, so that version 1 sends at that rate rather than all at
+ * date 0, and the PDUs of a window leave one after the other.
+ * Retransmissions are the data PDUs sent by the client beyond one per message.
+ * The ack_us and delivery_us columns are the percentiles of the latency
+ * histograms of the version (mic_tcp_get_stats): first sending to ack on the
+ * client, submission to mic_tcp_recv on the server.
+ *
+ * The version is the reliability policy given to mic_tcp_socket_policy
+ * (MICTCP_POLICY or the default one without -p), see make bench.
+ *
+ * With -b, each direction also crosses its own bottleneck link of that rate
+ * with a drop-tail queue of -q bytes (the acks never wait behind the data);
+ * -c chooses the congestion control of the windowed versions and -w writes
+ * the trace of their windows, see make bench_cwnd.
+ *
+ * With -g, losses come in bursts of that mean length (Gilbert-Elliott: every
+ * datagram is lost in the bad state, none in the good one) while -l stays the
+ * average loss rate; -k 0 stops offering selective acknowledgements, see
+ * make bench_sack, and -d sets the duplicate acks that trigger a fast
+ * retransmit (0: the timer only), see make bench_fast. The timeouts and
+ * fast_retransmits columns are the counters of the client.
+ *
+ * -a sets how long the receiver may hold the ack of an in-order PDU (0: an
+ * ack per PDU), see make bench_ack; the acks column counts those the server
+ * sent.
+ *
+ * -o sets how long a partially reliable receiver holds a hole back before
+ * skipping it, see make bench_reorder (a MICTCP_TRACE trace replaces the loss
+ * and delay models, as in the applications). The out_of_order column counts
+ * the messages delivered after a later one.
+ *
+ * Usage: sim [-p v1|v2|v3|v4] [-n messages] [-s payload size] [-l loss %]
+ *            [-r RTT in ms] [-S seed] [-f text|csv|json] [-H]
+ *            [-b bottleneck kbit/s] [-q queue bytes] [-c reno|vegas|none] [-w cwnd trace]
+ *            [-g mean burst length] [-k 0|1] [-d duplicate acks]
+ *            [-a ack delay in µs] [-o hole hold in µs]
+ *        -H prints the CSV header line and exits
+ */
+#include <mictcp.h>
+#include <api/mictcp_core.h>
+#include <getopt.h>
+
+#define MAX_SIZE 1500
+#define ACCESS_KBPS 100000  /* interface of the client: a send that does not wait still takes its serialization time */
+
+/* Head of each message */
+struct stamp {
+    unsigned int index;
+    unsigned long sent;     /* virtual date, µs */
+} __attribute__((packed));
+
+static const char* columns = "version,messages,size,loss,rtt_ms,seed,delivered,duplicates,virtual_ms,"
+                             "goodput_kbps,msgs_per_s,retransmissions,delivered_loss,"
+                             "latency_us_p50,latency_us_p99,latency_us_max,sent,lost,real_ms,"
+                             "ack_us_p50,ack_us_p99,ack_us_p999,ack_us_max,"
+                             "delivery_us_p50,delivery_us_p99,delivery_us_p999,delivery_us_max,timeouts,fast_retransmits,acks,out_of_order";
+
+static int listen_fd;
+static int server_fd = -1;
+static int messages = 1000;
+static char* seen;                  /* per message index, delivered at least once */
+static unsigned long* latencies;    /* of the first delivery of each message, µs */
+static unsigned long delivered = 0;
+static unsigned long duplicates = 0;
+static unsigned long out_of_order = 0;
+static unsigned int last_index = 0;  /* highest index delivered + 1 */
+
+static int compare(const void* a, const void* b)
+{
+    unsigned long x = *(const unsigned long*) a;
+    unsigned long y = *(const unsigned long*) b;
+    return (x > y) - (x < y);
+}
+
+static void* server(void* arg)
+{
+    sim_endpoint(SERVER);
+    int fd = mic_tcp_accept(listen_fd, NULL);
+    __atomic_store_n(&server_fd, fd, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* The server application reads everything delivered so far, at the present virtual date */
+static void catch_up()
+{
+    char buffer[MAX_SIZE];
+    struct stamp s;
+    int fd = __atomic_load_n(&server_fd, __ATOMIC_ACQUIRE);
+
+    if(fd == -1) return;
+    sim_endpoint(SERVER);
+    while(app_buffer_free(fd) < RING_DEFAULT_CAPACITY) {
+        if(mic_tcp_recv(fd, buffer, sizeof(buffer)) < (int) sizeof(s)) continue;
+        memcpy(&s, buffer, sizeof(s));
+        if(s.index >= (unsigned int) messages) continue;
+        if(seen[s.index]) {
+            duplicates++;
+            continue;
+        }
+        seen[s.index] = 1;
+        if(s.index < last_index) out_of_order++;
+        else last_index = s.index + 1;
+        latencies[delivered++] = sim_now() - s.sent;
+    }
+    sim_endpoint(CLIENT);
+}
+
+int main(int argc, char** argv)
+{
+    int size = 1000;
+    float loss = 5;
+    unsigned long rtt = 20000;
+    unsigned int seed = 1;
+    const char* format = "text";
+    const char* policy = NULL;
+    const char* algorithm = NULL;
+    const char* cwnd_trace = NULL;
+    unsigned long bottleneck = 0;
+    unsigned long queue = 65536;
+    float burst = 0;
+    int sack = 1;
+    int dupack = DUPACK_THRESHOLD;
+    unsigned long ack_delay = ACK_DELAY;
+    unsigned long hold = REORDER_HOLD;
+    char payload[MAX_SIZE];
+    int opt;
+
+    while((opt = getopt(argc, argv, "p:n:s:l:r:S:f:Hb:q:c:w:g:k:d:a:o:")) != -1) {
+        switch(opt) {
+        case 'p': policy = optarg; break;
+        case 'n': messages = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 'r': rtt = atol(optarg) * 1000; break;
+        case 'S': seed = atoi(optarg); break;
+        case 'f': format = optarg; break;
+        case 'H': printf("%s\n", columns); return 0;
+        case 'b': bottleneck = atol(optarg) * 1000; break;
+        case 'q': queue = atol(optarg); break;
+        case 'c': algorithm = optarg; break;
+        case 'w': cwnd_trace = optarg; break;
+        case 'g': burst = atof(optarg); break;
+        case 'k': sack = atoi(optarg); break;
+        case 'd': dupack = atoi(optarg); break;
+        case 'a': ack_delay = atol(optarg); break;
+        case 'o': hold = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-p policy] [-n messages] [-s size] [-l loss %%] [-r RTT ms] [-S seed] [-f text|csv|json] [-H] "
+                    "[-b bottleneck kbit/s] [-q queue bytes] [-c congestion control] [-w cwnd trace] [-g mean burst] [-k 0|1] [-d duplicate acks] [-a ack delay µs] [-o hole hold µs]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(size < (int) sizeof(struct stamp) || size > MAX_SIZE - API_HD_Size) {
+        fprintf(stderr, "Payload size must be in [%d, %d]\n", (int) sizeof(struct stamp), MAX_SIZE - API_HD_Size);
+        return 1;
+    }
+    if(messages < 1 || rtt == 0) {
+        fprintf(stderr, "At least one message, and a non-zero RTT\n");
+        return 1;
+    }
+    if(burst != 0 && (burst < 1 || loss >= 100)) {
+        fprintf(stderr, "Bursts of at least one datagram, and a loss rate below 100%%\n");
+        return 1;
+    }
+    if(strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 && strcmp(format, "json") != 0) {
+        fprintf(stderr, "Unknown format %s\n", format);
+        return 1;
+    }
+    if(algorithm != NULL && set_congestion_control(algorithm) == -1) {
+        fprintf(stderr, "Unknown congestion control %s\n", algorithm);
+        return 1;
+    }
+    if(cwnd_trace != NULL && set_cwnd_trace(cwnd_trace) == -1) return 1;
+    set_sack(sack);
+    set_dupack_threshold(dupack);
+    set_ack_delay(ack_delay);
+    set_reorder_hold(hold);
+    if(policy == NULL) policy = getenv("MICTCP_POLICY");
+    const char* version = (policy != NULL) ? policy : "default";
+    seen = calloc(messages, 1);
+    latencies = malloc(messages * sizeof(unsigned long));
+
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    if(out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+
+    sim_enable();
+    sim_on_advance(catch_up);
+
+    mic_tcp_sock_addr addr = {"127.0.0.1", 10, 1234};
+    listen_fd = mic_tcp_socket_policy(SERVER, policy);
+    if(listen_fd == -1 || mic_tcp_bind(listen_fd, addr) == -1) {
+        fprintf(stderr, "Server socket failed\n");
+        return 1;
+    }
+    int fd = mic_tcp_socket_policy(CLIENT, policy);
+    if(fd == -1) {
+        fprintf(stderr, "Client socket failed\n");
+        return 1;
+    }
+
+    /* After mic_tcp_socket, which sets the loss rate of the version */
+    mic_tcp_impairment imp;
+    impair_get(&imp);
+    imp.loss_good = loss;
+    imp.loss_bad = loss;
+    imp.good_to_bad = 0;
+    imp.bad_to_good = 0;
+    if(burst > 0) {
+        /* Time in the bad state = loss rate, bad state left once per burst on average */
+        imp.loss_good = 0;
+        imp.loss_bad = 100;
+        imp.bad_to_good = 100 / burst;
+        imp.good_to_bad = imp.bad_to_good * loss / (100 - loss);
+    }
+    imp.delay_usec = rtt / 2;
+    imp.seed = seed;
+    set_impairment(&imp);
+    if(bottleneck > 0) {
+        mic_tcp_bottleneck link = {bottleneck, 2 * MAX_SIZE, queue, 0, 0, 0, 0, 0};
+        set_bottleneck(&link);
+    }
+
+    pthread_t server_th;
+    pthread_create(&server_th, NULL, server, NULL);
+    pthread_detach(server_th);
+
+    struct timespec real_start, real_end;
+    clock_gettime(CLOCK_MONOTONIC, &real_start);
+
+    if(mic_tcp_connect(fd, addr) == -1) {
+        fprintf(stderr, "Connection failed\n");
+        return 1;
+    }
+
+    /* The final ACK reaches the server, then its application leaves accept
+       (if the ACK was lost, the first message will establish the connection) */
+    sim_run(rtt);
+    for(int i = 0; i < 200 && __atomic_load_n(&server_fd, __ATOMIC_ACQUIRE) == -1; i++) {
+        usleep(1000);
+    }
+    mic_tcp_sim_stats before;
+    sim_stats(&before);
+    unsigned long start = get_now_time_usec();
+
+    memset(payload, 'x', sizeof(payload));
+    for(int i = 0; i < messages; i++) {
+        struct stamp s = {i, sim_now()};
+        catch_up();
+        memcpy(payload, &s, sizeof(s));
+        unsigned long sending = sim_now();
+        mic_tcp_send(fd, payload, size);
+        if(sim_now() == sending) {
+            /* The version did not wait: the datagram still has to leave the interface */
+            sim_run((API_HD_Size + size) * 8000UL / ACCESS_KBPS + 1);
+        }
+    }
+    mic_tcp_close(fd);
+    unsigned long elapsed = get_now_time_usec() - start;
+    mic_tcp_sim_stats after;
+    sim_stats(&after);
+
+    /* What is still in flight reaches the server, then its application */
+    sim_run(10 * rtt + 1000000);
+    catch_up();
+    clock_gettime(CLOCK_MONOTONIC, &real_end);
+
+    mic_tcp_impair_stats stats;
+    get_impairment_stats(&stats);
+    mic_tcp_stats client, server;
+    memset(&client, 0, sizeof(client));
+    memset(&server, 0, sizeof(server));
+    mic_tcp_get_stats(fd, &client);
+    mic_tcp_get_stats(__atomic_load_n(&server_fd, __ATOMIC_ACQUIRE), &server);
+    qsort(latencies, delivered, sizeof(unsigned long), compare);
+    long retransmissions = (long) (after.data[CLIENT] - before.data[CLIENT]) - messages;
+    double goodput = (elapsed > 0) ? delivered * size * 8 / (elapsed / 1e3) : 0;
+    double rate = (elapsed > 0) ? delivered / (elapsed / 1e6) : 0;
+    double delivered_loss = 1 - (double) delivered / messages;
+    unsigned long p50 = (delivered > 0) ? latencies[delivered / 2] : 0;
+    unsigned long p99 = (delivered > 0) ? latencies[delivered * 99 / 100] : 0;
+    unsigned long max = (delivered > 0) ? latencies[delivered - 1] : 0;
+    double real_ms = (real_end.tv_sec - real_start.tv_sec) * 1e3 + (real_end.tv_nsec - real_start.tv_nsec) / 1e6;
+
+    if(strcmp(format, "csv") == 0) {
+        fprintf(out, "%s,%d,%d,%.1f,%lu,%u,%lu,%lu,%.1f,%.0f,%.0f,%ld,%.4f,%lu,%lu,%lu,%lu,%lu,%.1f,"
+                "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                version, messages, size, loss, rtt / 1000, seed, delivered, duplicates, elapsed / 1e3,
+                goodput, rate, retransmissions, delivered_loss, p50, p99, max, stats.sent, stats.lost, real_ms,
+                client.ack_latency_p50_usec, client.ack_latency_p99_usec, client.ack_latency_p999_usec,
+                client.ack_latency_max_usec, server.delivery_latency_p50_usec, server.delivery_latency_p99_usec,
+                server.delivery_latency_p999_usec, server.delivery_latency_max_usec,
+                client.timeouts, client.fast_retransmits, server.acks_sent, out_of_order);
+    } else if(strcmp(format, "json") == 0) {
+        fprintf(out, "{\"version\": \"%s\", \"messages\": %d, \"size\": %d, \"loss\": %.1f, \"rtt_ms\": %lu, \"seed\": %u, "
+                "\"delivered\": %lu, \"duplicates\": %lu, \"virtual_ms\": %.1f, \"goodput_kbps\": %.0f, \"msgs_per_s\": %.0f, "
+                "\"retransmissions\": %ld, \"delivered_loss\": %.4f, \"latency_us\": {\"p50\": %lu, \"p99\": %lu, \"max\": %lu}, "
+                "\"sent\": %lu, \"lost\": %lu, \"real_ms\": %.1f, "
+                "\"ack_us\": {\"p50\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}, "
+                "\"delivery_us\": {\"p50\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}, "
+                "\"timeouts\": %lu, \"fast_retransmits\": %lu, \"acks\": %lu, \"out_of_order\": %lu}\n",
+                version, messages, size, loss, rtt / 1000, seed, delivered, duplicates, elapsed / 1e3,
+                goodput, rate, retransmissions, delivered_loss, p50, p99, max, stats.sent, stats.lost, real_ms,
+                client.ack_latency_p50_usec, client.ack_latency_p99_usec, client.ack_latency_p999_usec,
+                client.ack_latency_max_usec, server.delivery_latency_p50_usec, server.delivery_latency_p99_usec,
+                server.delivery_latency_p999_usec, server.delivery_latency_max_usec,
+                client.timeouts, client.fast_retransmits, server.acks_sent, out_of_order);
+    } else {
+        fprintf(out, "version=%s messages=%d size=%d loss=%.1f rtt_ms=%lu seed=%u delivered=%lu duplicates=%lu "
+                "virtual_ms=%.1f goodput_kbps=%.0f msgs_per_s=%.0f retransmissions=%ld delivered_loss=%.4f "
+                "latency_us_p50=%lu p99=%lu max=%lu sent=%lu lost=%lu real_ms=%.1f "
+                "ack_us_p50=%lu p99=%lu p99.9=%lu max=%lu delivery_us_p50=%lu p99=%lu p99.9=%lu max=%lu "
+                "timeouts=%lu fast_retransmits=%lu acks=%lu out_of_order=%lu\n",
+                version, messages, size, loss, rtt / 1000, seed, delivered, duplicates, elapsed / 1e3,
+                goodput, rate, retransmissions, delivered_loss, p50, p99, max, stats.sent, stats.lost, real_ms,
+                client.ack_latency_p50_usec, client.ack_latency_p99_usec, client.ack_latency_p999_usec,
+                client.ack_latency_max_usec, server.delivery_latency_p50_usec, server.delivery_latency_p99_usec,
+                server.delivery_latency_p999_usec, server.delivery_latency_max_usec,
+                client.timeouts, client.fast_retransmits, server.acks_sent, out_of_order);
+    }
+    return 0;
+}
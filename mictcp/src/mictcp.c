@@ -0,0 +1,209 @@
+/** Choix de la version du protocole, socket par socket :
+ *  chaque version (src/mictcp_vN.c) fournit ses fonctions dans une politique
+ *  (mictcp_policy.h), et les fonctions de l'interface appellent celles de la
+ *  politique du socket. Toutes les versions sont donc dans le même programme.
+ *
+ *  mic_tcp_socket prend la politique nommée par la variable d'environnement
+ *  MICTCP_POLICY (v1 à v4), la version 4 à défaut ; mic_tcp_socket_policy la
+ *  choisit explicitement. Un socket créé par une version (connexion reçue par
+ *  un socket en écoute de la version 4) prend la politique de celle-ci.
+ *
+ *  Les versions 1 à 3 n'ont qu'un socket global et ne passent pas par
+ *  l'aiguillage du cœur : les PDU qu'aucun socket ne réclame vont à la
+ *  politique du dernier socket créé par l'application.
+ */
+#include <mictcp.h>
+#include <mictcp_policy.h>
+#include <api/mictcp_core.h>
+
+#define POLITIQUE_DEFAUT "v4"
+
+static const mic_tcp_policy* politiques[] = {&mictcp_v1, &mictcp_v2, &mictcp_v3, &mictcp_v4};
+
+static const mic_tcp_policy* politique_socket[MAX_SOCKETS];
+static const mic_tcp_policy* derniere_politique = NULL; // Politique du dernier socket créé par l'application
+static __thread const mic_tcp_policy* politique_courante = NULL; // Politique qu'exécute ce thread
+
+/*
+ * Donne au socket que le cœur vient d'allouer la politique en cours d'exécution
+ */
+static void adopter(int socket)
+{
+    if (politique_courante!=NULL){
+        __atomic_store_n(&politique_socket[socket], politique_courante, __ATOMIC_RELEASE);
+    }
+}
+
+static const mic_tcp_policy* trouver_politique(const char* nom)
+{
+    for (int i=0; i<sizeof(politiques)/sizeof(politiques[0]); i++){
+        if (strcmp(politiques[i]->name, nom)==0) return politiques[i];
+    }
+    return NULL;
+}
+
+static const mic_tcp_policy* politique(int socket)
+{
+    if (socket<0 || socket>=MAX_SOCKETS) return NULL;
+    return __atomic_load_n(&politique_socket[socket], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Le thread exécute la politique p jusqu'à sortir(), qui rend la précédente
+ */
+static const mic_tcp_policy* entrer(const mic_tcp_policy* p)
+{
+    const mic_tcp_policy* precedente=politique_courante;
+    politique_courante=p;
+    return precedente;
+}
+
+static void sortir(const mic_tcp_policy* precedente)
+{
+    politique_courante=precedente;
+}
+
+/*
+ * Permet de créer un socket entre l’application et MIC-TCP, avec la politique
+ * nommée (NULL : celle de MICTCP_POLICY, ou la version 4)
+ * Retourne le descripteur du socket ou bien -1 en cas d'erreur
+ */
+int mic_tcp_socket_policy(start_mode sm, const char* nom)
+{
+    if (nom==NULL) nom=getenv("MICTCP_POLICY");
+    if (nom==NULL) nom=POLITIQUE_DEFAUT;
+
+    const mic_tcp_policy* p=trouver_politique(nom);
+    if (p==NULL){
+        LOG_ERROR("Erreur : politique %s inconnue", nom);
+        return -1;
+    }
+
+    set_socket_hook(adopter);
+    const mic_tcp_policy* precedente=entrer(p);
+    int socket=p->socket(sm);
+    sortir(precedente);
+
+    if (socket!=-1){
+        __atomic_store_n(&politique_socket[socket], p, __ATOMIC_RELEASE);
+        __atomic_store_n(&derniere_politique, p, __ATOMIC_RELEASE);
+    }
+    return socket;
+}
+
+int mic_tcp_socket(start_mode sm)
+{
+    return mic_tcp_socket_policy(sm, NULL);
+}
+
+int mic_tcp_bind(int socket, mic_tcp_sock_addr addr)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->bind(socket, addr);
+    sortir(precedente);
+    return result;
+}
+
+int mic_tcp_accept(int socket, mic_tcp_sock_addr* addr)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->accept(socket, addr);
+    sortir(precedente);
+    return result;
+}
+
+int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->connect(socket, addr);
+    sortir(precedente);
+    return result;
+}
+
+int mic_tcp_send(int socket, char* mesg, int mesg_size)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->send(socket, mesg, mesg_size);
+    sortir(precedente);
+    return result;
+}
+
+int mic_tcp_recv(int socket, char* mesg, int max_mesg_size)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->recv(socket, mesg, max_mesg_size);
+    sortir(precedente);
+    return result;
+}
+
+int mic_tcp_close(int socket)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    int result=p->close(socket);
+    sortir(precedente);
+    return result;
+}
+
+unsigned long mic_tcp_get_rto(int socket)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return 0;
+    return p->get_rto(socket);
+}
+
+int mic_tcp_set_loss_tolerance(int socket, unsigned short percent)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+    return p->set_loss_tolerance(socket, percent);
+}
+
+int mic_tcp_set_ack_delay(int socket, unsigned long delay_usec)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) return -1;
+    return p->set_ack_delay(socket, delay_usec);
+}
+
+/*
+ * Permet de consulter les compteurs du socket (voir mic_tcp_stats)
+ * Retourne 0 si succès, -1 si le socket n'existe pas
+ */
+int mic_tcp_get_stats(int socket, mic_tcp_stats* stats)
+{
+    if (politique(socket)==NULL || stats==NULL) return -1;
+    return stats_get(socket, stats);
+}
+
+/*
+ * Appelée par le cœur pour chaque PDU reçu, socket étant celui que lui a
+ * désigné l'aiguillage (-1 si aucun)
+ */
+void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
+{
+    const mic_tcp_policy* p=politique(socket);
+    if (p==NULL) p=__atomic_load_n(&derniere_politique, __ATOMIC_ACQUIRE);
+    if (p==NULL) return;
+
+    const mic_tcp_policy* precedente=entrer(p);
+    p->process_received_PDU(pdu, addr, socket);
+    sortir(precedente);
+}
@@ -3,24 +3,25 @@
  * 
  */
 #include <mictcp.h>
+#include <mictcp_policy.h>
 #include <api/mictcp_core.h>
 
-mic_tcp_sock socket_local; 
+static mic_tcp_sock socket_local={.fd=-1}; // Seul socket de cette version, -1 avant le premier mic_tcp_socket
 
 /*
  * Permet de créer un socket entre l’application et MIC-TCP
  * Retourne le descripteur du socket ou bien -1 en cas d'erreur
  */
-int mic_tcp_socket(start_mode sm)
+static int v1_socket(start_mode sm)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
    
     if(initialize_components(sm)==-1){
-       printf("Erreur initialise components \n");
+       LOG_ERROR("Erreur initialise components");
     }
     set_loss_rate(0);
 
-    socket_local.fd=1;
+    if (socket_local.fd==-1) socket_local.fd=socket_alloc(); // Un second socket de cette version reprend le premier
     socket_local.state=IDLE; // Non défini
 
     return socket_local.fd;
@@ -30,29 +31,29 @@ int mic_tcp_socket(start_mode sm)
  * Permet d’attribuer une adresse à un socket.
  * Retourne 0 si succès, et -1 en cas d’échec
  */
-int mic_tcp_bind(int socket, mic_tcp_sock_addr addr)
+static int v1_bind(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return 0;
 }
 
 /*
  * Met le socket en état d'acceptation de connexions
- * Retourne 0 si succès, -1 si erreur
+ * Retourne le socket de la connexion (ici le socket lui-même : une seule connexion), -1 si erreur
  */
-int mic_tcp_accept(int socket, mic_tcp_sock_addr* addr)
+static int v1_accept(int socket, mic_tcp_sock_addr* addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
-    return 0;
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+    return socket_local.fd;
 }
 
 /*
  * Permet de réclamer l’établissement d’une connexion
  * Retourne 0 si la connexion est établie, et -1 en cas d’échec
  */
-int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
+static int v1_connect(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     socket_local.state=ESTABLISHED;
     return 0;
 }
@@ -61,18 +62,21 @@ int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
  * Permet de réclamer l’envoi d’une donnée applicative
  * Retourne la taille des données envoyées, et -1 en cas d'erreur
  */
-int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
+static int v1_send(int mic_sock, char* mesg, int mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     // Vérifier qu'on est connecté
-    if (socket_local.state!=ESTABLISHED) printf("Erreur : Connection non établie \n");     
+    if (socket_local.state!=ESTABLISHED) LOG_ERROR("Erreur : Connection non établie");
 
     /* Encapsulation */
-    mic_tcp_pdu pdu;
+    mic_tcp_pdu pdu={0};
         // Header
+    pdu.header.source_port=socket_local.addr.port;
+    pdu.header.dest_port=0;
     pdu.header.seq_num=0;
     pdu.header.ack_num=0;
+    pdu.header.timestamp=get_now_time_usec(); // Date de soumission, pour la latence de remise
     pdu.header.syn=0;
     pdu.header.ack=0;
     pdu.header.fin=0;
@@ -82,9 +86,10 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
 
     int sent_size=IP_send(pdu, socket_local.addr);
     if(sent_size==-1){
-        printf("Erreur d'envoi \n");
+        LOG_ERROR("Erreur d'envoi");
         return -1;
     }
+    STATS_ADD(socket_local.fd, pdu_sent, 1);
 
     return sent_size;
 }
@@ -95,15 +100,15 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
  * Retourne le nombre d’octets lu ou bien -1 en cas d’erreur
  * NB : cette fonction fait appel à la fonction app_buffer_get()
  */
-int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
+static int v1_recv(int socket, char* mesg, int max_mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     // Lire le socket 
     mic_tcp_payload payload;
     payload.data = mesg;
     payload.size = max_mesg_size;
-    int read_size = app_buffer_get(payload);
+    int read_size = app_buffer_get(socket_local.fd, payload);
 
     return read_size;
 }
@@ -113,20 +118,66 @@ int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
  * Engendre la fermeture de la connexion suivant le modèle de TCP.
  * Retourne 0 si tout se passe bien et -1 en cas d'erreur
  */
-int mic_tcp_close (int socket)
+static int v1_close(int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction :  "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return -1;
 }
 
+/*
+ * Permet de consulter le timer de retransmission courant du socket
+ * Retourne sa valeur en µs (toujours 0 : cette version ne renvoie jamais)
+ */
+static unsigned long v1_get_rto(int socket)
+{
+    return 0;
+}
+
+/*
+ * Permet de choisir le % de pertes admissibles avant l'établissement de la connexion
+ * Retourne 0 si succès, -1 en cas d'erreur (cette version ne reprend aucune perte : seul 100% est possible)
+ */
+static int v1_set_loss_tolerance(int socket, unsigned short percent)
+{
+    return (percent==100) ? 0 : -1;
+}
+
+/*
+ * Permet de choisir le délai maximal d'acquittement d'un PDU reçu dans l'ordre (0 : ack immédiat)
+ * Retourne 0 si succès, -1 en cas d'erreur (cette version n'envoie aucun ack : seul 0 est possible)
+ */
+static int v1_set_ack_delay(int socket, unsigned long delay_usec)
+{
+    return (delay_usec==0) ? 0 : -1;
+}
+
 /*
  * Traitement d’un PDU MIC-TCP reçu (mise à jour des numéros de séquence
  * et d'acquittement, etc.) puis insère les données utiles du PDU dans
  * le buffer de réception du socket. Cette fonction utilise la fonction
  * app_buffer_put().
  */
-void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr)
+static void v1_process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
-    app_buffer_put(pdu.payload);
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+    STATS_ADD(socket_local.fd, pdu_received, 1);
+    if (app_buffer_put(socket_local.fd, pdu.payload, pdu.header.timestamp)!=-1) STATS_ADD(socket_local.fd, bytes_delivered, pdu.payload.size);
 }
+
+/*
+ * Fonctions de cette version, appelées par l'interface (src/mictcp.c)
+ */
+const mic_tcp_policy mictcp_v1={
+    .name="v1",
+    .socket=v1_socket,
+    .bind=v1_bind,
+    .accept=v1_accept,
+    .connect=v1_connect,
+    .send=v1_send,
+    .recv=v1_recv,
+    .close=v1_close,
+    .get_rto=v1_get_rto,
+    .set_loss_tolerance=v1_set_loss_tolerance,
+    .set_ack_delay=v1_set_ack_delay,
+    .process_received_PDU=v1_process_received_PDU
+};
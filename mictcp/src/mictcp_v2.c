@@ -3,35 +3,42 @@
  *      de type « Stop and Wait ». 
  * 
  *  On envoie donc un message et attend de recevoir l'ack. 
- *      Si il n'est pas recu ou incorrect, on renvoie. 
+ *      Si il n'est pas recu avant l'expiration du timer, on renvoie.
+ *      Un ack non conforme à celui attendu (ack d'un envoi précédent) est ignoré.
  *  
  */
 #include <mictcp.h>
+#include <mictcp_policy.h>
 #include <api/mictcp_core.h>
+#include <api/mictcp_rto.h>
 #include <time.h>
 
 #define LOSS_RATE 50  // En pourcentage, taux de perte fixé
 
-mic_tcp_sock socket_local; 
+static mic_tcp_sock socket_local={.fd=-1}; // Seul socket de cette version, -1 avant le premier mic_tcp_socket
 
-int num_sequence=0;
-int num_attendu=0;
+static int num_sequence=0;
+static int num_attendu=0;
+
+static mic_tcp_rto rto; // Estimation du timer de retransmission
 
 /*
  * Permet de créer un socket entre l’application et MIC-TCP
  * Retourne le descripteur du socket ou bien -1 en cas d'erreur
  */
-int mic_tcp_socket(start_mode sm)
+static int v2_socket(start_mode sm)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     if(initialize_components(sm)==-1){
-        printf("Erreur initialise components \n");
+        LOG_ERROR("Erreur initialise components");
     }
     set_loss_rate(LOSS_RATE);
+    rto_init(&rto);
 
-    socket_local.fd=1;
+    if (socket_local.fd==-1) socket_local.fd=socket_alloc(); // Un second socket de cette version reprend le premier
     socket_local.state=IDLE; // Non défini
+    stats_rto(socket_local.fd, &rto);
 
     return socket_local.fd;
 }
@@ -40,29 +47,29 @@ int mic_tcp_socket(start_mode sm)
  * Permet d’attribuer une adresse à un socket.
  * Retourne 0 si succès, et -1 en cas d’échec
  */
-int mic_tcp_bind(int socket, mic_tcp_sock_addr addr)
+static int v2_bind(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return 0;
 }
 
 /*
  * Met le socket en état d'acceptation de connexions
- * Retourne 0 si succès, -1 si erreur
+ * Retourne le socket de la connexion (ici le socket lui-même : une seule connexion), -1 si erreur
  */
-int mic_tcp_accept(int socket, mic_tcp_sock_addr* addr)
+static int v2_accept(int socket, mic_tcp_sock_addr* addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
-    return 0;
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+    return socket_local.fd;
 }
 
 /*
  * Permet de réclamer l’établissement d’une connexion
  * Retourne 0 si la connexion est établie, et -1 en cas d’échec
  */
-int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
+static int v2_connect(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     socket_local.state=ESTABLISHED;
     return 0;
 }
@@ -71,18 +78,21 @@ int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
  * Permet de réclamer l’envoi d’une donnée applicative
  * Retourne la taille des données envoyées, et -1 en cas d'erreur
  */
-int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
+static int v2_send(int mic_sock, char* mesg, int mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
 
     // Vérifier qu'on est connecté
-    if (socket_local.state!=ESTABLISHED) printf("Erreur : Connection non établie \n");     
+    if (socket_local.state!=ESTABLISHED) LOG_ERROR("Erreur : Connection non établie");
 
     /* Encapsulation */
-    mic_tcp_pdu pdu;
+    mic_tcp_pdu pdu={0};
         // Header
+    pdu.header.source_port=socket_local.addr.port;
+    pdu.header.dest_port=0;
     pdu.header.seq_num=num_sequence;
     pdu.header.ack_num=num_sequence;
+    pdu.header.timestamp=get_now_time_usec(); // Date de soumission, pour la latence de remise
     pdu.header.syn=0;
     pdu.header.ack=0;
     pdu.header.fin=0;
@@ -91,32 +101,57 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
     pdu.payload.size=mesg_size;
 
     /* Création du pdu servant à recupérer l'ack */
-    mic_tcp_pdu pdu_ack;
-    pdu_ack.payload.size=0;
-    pdu_ack.header.ack_num=num_sequence;
+    mic_tcp_pdu pdu_ack={0};
 
     num_sequence=(num_sequence+1)%2; // Mise à jour du numéro de séquence
 
     /* Attente de l'ACK */
     int sent_size;
-    while(pdu_ack.header.ack_num!=num_sequence){ // Regarde si le numéro reçu est correct
+    int nb_envois=0;
+    unsigned long date_envoi=0;
+    unsigned long premier_envoi=0; // Date du premier envoi en µs
+    int recu=0; // 1 une fois l'ack de ce message reçu
+
+    while(!recu){
 
         // Envoi pdu
+        date_envoi=get_now_time_usec();
+        nb_envois++;
+        if (nb_envois==1) premier_envoi=date_envoi;
         sent_size=IP_send(pdu, socket_local.addr);
         if (sent_size==-1) {
-            printf("Erreur d'envoi \n");
+            LOG_ERROR("Erreur d'envoi");
             exit(1);
         }
+        STATS_ADD(socket_local.fd, pdu_sent, 1);
+        if (nb_envois>1) STATS_ADD(socket_local.fd, retransmissions, 1);
 
-        // Attente d'expiration du timer ou ack reçu
-        if (IP_recv(&pdu_ack, &socket_local.addr, 10)==-1){
-            printf("Paquet perdu, on renvoie \n");
-        } else {
-            break;
+        // Attente de l'ack jusqu'à l'expiration du timer : un ack périmé ne provoque pas de renvoi
+        unsigned long echeance=date_envoi+rto_get(&rto);
+        unsigned long maintenant=date_envoi;
+        while (maintenant<echeance && IP_recv_us(&pdu_ack, &socket_local.addr, echeance-maintenant)!=-1){
+            STATS_ADD(socket_local.fd, pdu_received, 1);
+            if (pdu_ack.header.ack_num==num_sequence){ // Regarde si le numéro reçu est correct
+                // Mesure du RTT, ignorée si le message a été renvoyé (règle de Karn)
+                rto_ack(&rto, get_now_time_usec()-date_envoi, nb_envois>1);
+                stats_rto(socket_local.fd, &rto);
+                stats_ack_latency(socket_local.fd, get_now_time_usec()-premier_envoi);
+                recu=1;
+                break;
+            }
+            // Ack d'un envoi précédent : on attend encore le bon
+            LOG_TRACE("Ack ignoré = %d", pdu_ack.header.ack_num);
+            maintenant=get_now_time_usec();
         }
+        if (recu) break;
+
+        LOG_DEBUG("Paquet perdu, on renvoie");
+        rto_backoff(&rto);
+        stats_rto(socket_local.fd, &rto);
+        STATS_ADD(socket_local.fd, timeouts, 1);
     }
 
-    printf("Message bien envoyé ! \n");
+    LOG_TRACE("Message bien envoyé !");
 
     return sent_size;
 }
@@ -127,15 +162,15 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
  * Retourne le nombre d’octets lu ou bien -1 en cas d’erreur
  * NB : cette fonction fait appel à la fonction app_buffer_get()
  */
-int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
+static int v2_recv(int socket, char* mesg, int max_mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     // Lire le socket 
     mic_tcp_payload payload;
     payload.data = mesg;
     payload.size = max_mesg_size;
-    int read_size = app_buffer_get(payload);
+    int read_size = app_buffer_get(socket_local.fd, payload);
     
     return read_size;
 }
@@ -145,36 +180,87 @@ int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
  * Engendre la fermeture de la connexion suivant le modèle de TCP.
  * Retourne 0 si tout se passe bien et -1 en cas d'erreur
  */
-int mic_tcp_close (int socket)
+static int v2_close(int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction :  "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return -1;
 }
 
+/*
+ * Permet de consulter le timer de retransmission courant du socket
+ * Retourne sa valeur en µs
+ */
+static unsigned long v2_get_rto(int socket)
+{
+    return rto_get(&rto);
+}
+
+/*
+ * Permet de choisir le % de pertes admissibles avant l'établissement de la connexion
+ * Retourne 0 si succès, -1 en cas d'erreur (cette version reprend toutes les pertes : seul 0% est possible)
+ */
+static int v2_set_loss_tolerance(int socket, unsigned short percent)
+{
+    return (percent==0) ? 0 : -1;
+}
+
+/*
+ * Permet de choisir le délai maximal d'acquittement d'un PDU reçu dans l'ordre (0 : ack immédiat)
+ * Retourne 0 si succès, -1 en cas d'erreur (cette version acquitte chaque PDU aussitôt : seul 0 est possible)
+ */
+static int v2_set_ack_delay(int socket, unsigned long delay_usec)
+{
+    return (delay_usec==0) ? 0 : -1;
+}
+
 /*
  * Traitement d’un PDU MIC-TCP reçu (mise à jour des numéros de séquence
  * et d'acquittement, etc.) puis insère les données utiles du PDU dans
  * le buffer de réception du socket. Cette fonction utilise la fonction
  * app_buffer_put().
  */
-void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr)
+static void v2_process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     /* Créé le pdu qui sera envoyé */
-    mic_tcp_pdu pdu_ack;
-    pdu_ack.payload.size=0;
-    pdu_ack.header.ack_num=pdu.header.ack_num;
+    mic_tcp_pdu pdu_ack={0}; // Ce pdu ne sert qu'a envoyer l'ack, donc pas de payload
+    pdu_ack.header.source_port=socket_local.addr.port;
+    pdu_ack.header.dest_port=pdu.header.source_port;
     
+    STATS_ADD(socket_local.fd, pdu_received, 1);
+
     // Teste la reception du bon message
-    if (pdu.header.seq_num==num_attendu){
-        app_buffer_put(pdu.payload);
+    if (pdu.header.seq_num==num_attendu && app_buffer_put(socket_local.fd, pdu.payload, pdu.header.timestamp)!=-1){ // Buffer plein : pas d'ack, le message sera renvoyé
         num_attendu=(num_attendu+1)%2; // Met à jour le num attendu
-        pdu_ack.header.ack_num=(pdu.header.ack_num+1)%2; // Met à jour l'ack
+        STATS_ADD(socket_local.fd, bytes_delivered, pdu.payload.size);
+    } else if (pdu.header.seq_num!=num_attendu){ // Ack perdu : le message a déjà été reçu
+        STATS_ADD(socket_local.fd, duplicates, 1);
     }
+    pdu_ack.header.ack_num=num_attendu; // Acquitte le prochain numéro attendu, y compris pour un doublon
 
     if (IP_send(pdu_ack, socket_local.addr)==-1){ // Envoi l'ack
-        printf("Erreur lors de l'envoi de l'ack \n");
+        LOG_ERROR("Erreur lors de l'envoi de l'ack");
         exit(1);
     }
+    STATS_ADD(socket_local.fd, pdu_sent, 1);
+    STATS_ADD(socket_local.fd, acks_sent, 1);
 }
+
+/*
+ * Fonctions de cette version, appelées par l'interface (src/mictcp.c)
+ */
+const mic_tcp_policy mictcp_v2={
+    .name="v2",
+    .socket=v2_socket,
+    .bind=v2_bind,
+    .accept=v2_accept,
+    .connect=v2_connect,
+    .send=v2_send,
+    .recv=v2_recv,
+    .close=v2_close,
+    .get_rto=v2_get_rto,
+    .set_loss_tolerance=v2_set_loss_tolerance,
+    .set_ack_delay=v2_set_ack_delay,
+    .process_received_PDU=v2_process_received_PDU
+};
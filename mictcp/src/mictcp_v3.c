@@ -5,41 +5,219 @@
  * 
  *  On envoie donc un message et attend de recevoir l'ack. 
  *      Si il n'est pas recu, on verifie la tolérance et renvoie si besoin. 
- *      Si il est recu et pas conforme à ce attendu, on renvoie systématique le message.
+ *      Un ack non conforme à celui attendu (SYN-ACK répété, ack d'un envoi précédent) est ignoré : seul le timer déclenche un renvoi.
  *  
  *  Par ailleurs, dans cette version, nous ne ferons plus de modulo 2 sur le numero de séquence et d'acquisition.
  *  Cela permet d'éviter l'erreur causé par un saut de message.
- *  Une amélioration de ce programme pourrait etre une remise à zéro des compteurs au bout d'un certain nombre d'envois, pour ne pas épuiser la mémoire.
+ *  La décision de tolérer une perte ne porte que sur les FENETRE_PERTES derniers messages :
+ *      au plus tolerance % d'entre eux peuvent être perdus, quel que soit le passé de la connexion.
+ *      (ou sur 100/tolerance messages si FENETRE_PERTES est trop court pour en admettre un seul).
+ *
+ *  Le % de pertes admissibles est négocié à l'établissement de la connexion :
+ *      le client le propose dans son SYN, le serveur l'accepte ou le diminue dans son SYN-ACK,
+ *      puis les deux côtés appliquent la valeur retenue (0 = fiabilité totale).
+ *
+ *  Le récepteur acquitte tout PDU reçu, mais ne délivre à l'application que dans l'ordre :
+ *      un PDU arrivé au-delà d'un trou (original retardé, renvoi doublé par le suivant) attend
+ *      dans le tampon de réordonnancement, un anneau de TAILLE_REORDRE places indexé par
+ *      seq_num modulo sa taille avec une table de bits des places occupées. La suite contiguë
+ *      part dès que le trou est comblé. Si des pertes sont admises, l'émetteur a pu abandonner
+ *      le PDU manquant : le trou est sauté une fois que le PDU qui le suit a attendu
+ *      get_reorder_hold() µs (MICTCP_REORDER_HOLD), l'échéance passant par le timer du cœur.
  */
 #include <mictcp.h>
+#include <mictcp_policy.h>
 #include <api/mictcp_core.h>
+#include <api/mictcp_rto.h>
+#include <api/mictcp_loss.h>
 
 #define LOSS_RATE 60  // En pourcentage, taux de perte fixé
-#define TOLERANCE 0.5 // Seuil de tolérance = pertes admises (0=0%; 1=100%)
+#define TOLERANCE 50  // Pertes admises par défaut, en pourcentage
+#define MAX_ESSAIS_CONNEXION 20 // Nombre d'envois du SYN avant abandon
+#define FENETRE_PERTES 20 // Nombre de messages consécutifs sur lesquels porte la tolérance
+#define TAILLE_REORDRE 64 // Places du tampon de réordonnancement, multiple de BITS_MOT
+#define BITS_MOT (8*sizeof(unsigned long)) // Places par mot de la table des places occupées
+#define MAX_DATA_SIZE (1500 - API_HD_Size) // Taille maximale des données d'un PDU
 
-mic_tcp_sock socket_local; 
+static mic_tcp_sock socket_local={.fd=-1}; // Seul socket de cette version, -1 avant le premier mic_tcp_socket
 
-int num_sequence=0;
-int num_aquisition=0;
+static int num_sequence=0;
+static unsigned int num_aquisition=0; // Prochain PDU à délivrer
 
-double compt_env=0;
-double compt_rec=0;
+static mic_tcp_rto rto; // Estimation du timer de retransmission
+
+static unsigned short tolerance=TOLERANCE; // Pertes admises : proposées (client) ou maximales (serveur), puis négociées
+static loss_budget pertes; // Pertes sur les derniers messages envoyés
+
+/*
+ * Place du tampon de réordonnancement : un PDU reçu en attente de sa délivrance
+ */
+typedef struct place
+{
+    char data[MAX_DATA_SIZE];   // copie des données applicatives
+    int size;                   // taille des données
+    unsigned int horodatage;    // date de soumission par l'application émettrice (portée par le PDU)
+    unsigned long arrivee;      // date de réception en µs
+} place;
+
+/* Tampon de réordonnancement : PDU de numéro num_aquisition à num_aquisition+TAILLE_REORDRE-1 */
+static place reordre[TAILLE_REORDRE];
+static unsigned long occupees[TAILLE_REORDRE/BITS_MOT]; // bit à 1 : place occupée
+static unsigned int nb_gardes=0;    // places occupées
+static pthread_mutex_t verrou_reordre=PTHREAD_MUTEX_INITIALIZER; // Réception et timer du cœur
+
+/* Attente de l'établissement de la connexion par mic_tcp_accept */
+static pthread_mutex_t verrou_connexion=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_connexion=PTHREAD_COND_INITIALIZER;
+
+/*
+ * Prépare un PDU de contrôle (sans données) avec les flags donnés
+ */
+static void preparer_controle(mic_tcp_pdu* pdu, unsigned char syn, unsigned char ack, unsigned int ack_num)
+{
+    pdu->header.source_port=socket_local.addr.port;
+    pdu->header.dest_port=0;
+    pdu->header.seq_num=0;
+    pdu->header.ack_num=ack_num;
+    pdu->header.timestamp=0;
+    pdu->header.syn=syn;
+    pdu->header.ack=ack;
+    pdu->header.fin=0;
+    pdu->payload.data=NULL;
+    pdu->payload.size=0;
+}
+
+/*
+ * Passage en état ESTABLISHED côté serveur, et réveil de mic_tcp_accept
+ */
+static void connexion_etablie()
+{
+    pthread_mutex_lock(&verrou_connexion);
+    socket_local.state=ESTABLISHED;
+    pthread_cond_broadcast(&cond_connexion);
+    pthread_mutex_unlock(&verrou_connexion);
+}
+
+/*
+ * Réponse à un SYN : retient le minimum entre le % de pertes proposé et le nôtre,
+ * puis le renvoie dans un SYN-ACK (un SYN répété reçoit la même réponse)
+ */
+static void repondre_syn(mic_tcp_pdu pdu, mic_tcp_sock_addr addr)
+{
+    unsigned char proposition=(pdu.payload.size>=1) ? (unsigned char)pdu.payload.data[0] : 0;
+
+    pthread_mutex_lock(&verrou_connexion);
+    if (proposition<tolerance) tolerance=proposition;
+    if (socket_local.state!=ESTABLISHED) socket_local.state=SYN_RECEIVED;
+    unsigned char accepte=tolerance;
+    pthread_mutex_unlock(&verrou_connexion);
+
+    mic_tcp_pdu syn_ack;
+    preparer_controle(&syn_ack, 1, 1, 0);
+    syn_ack.header.dest_port=pdu.header.source_port;
+    syn_ack.payload.data=(char*)&accepte;
+    syn_ack.payload.size=1;
+    if (IP_send(syn_ack, addr)==-1){
+        LOG_ERROR("Erreur dans l'envoi du SYN-ACK");
+        return;
+    }
+    STATS_ADD(socket_local.fd, pdu_sent, 1);
+}
+
+/*
+ * Vrai si le PDU num est gardé dans le tampon de réordonnancement
+ */
+static int garde(unsigned int num)
+{
+    return (occupees[(num%TAILLE_REORDRE)/BITS_MOT]>>(num%BITS_MOT))&1;
+}
+
+static void marquer(unsigned int num, int occupe)
+{
+    unsigned long bit=1UL<<(num%BITS_MOT);
+
+    if (occupe) occupees[(num%TAILLE_REORDRE)/BITS_MOT]|=bit;
+    else occupees[(num%TAILLE_REORDRE)/BITS_MOT]&=~bit;
+}
+
+/*
+ * Délivre à l'application la suite contiguë du tampon, tant que le buffer de réception a de la place.
+ * Appelée avec verrou_reordre pris.
+ */
+static void delivrer()
+{
+    while (nb_gardes>0 && garde(num_aquisition)){
+        place* p=&reordre[num_aquisition%TAILLE_REORDRE];
+        mic_tcp_payload payload;
+        payload.data=p->data;
+        payload.size=p->size;
+        if (app_buffer_put(socket_local.fd, payload, p->horodatage)==-1) return; // Plein : mic_tcp_recv reprendra
+        STATS_ADD(socket_local.fd, bytes_delivered, p->size);
+        marquer(num_aquisition, 0);
+        nb_gardes--;
+        num_aquisition++;
+    }
+}
+
+static void trou_expire(int socket);
+
+/*
+ * Délivre ce qui peut l'être puis, si des pertes sont admises, saute chaque trou devant lequel
+ * un PDU attend depuis get_reorder_hold() µs ; sinon le timer du cœur rappellera à l'échéance.
+ * Appelée avec verrou_reordre pris.
+ */
+static void sauter_trous()
+{
+    unsigned long maintenant=get_now_time_usec();
+    unsigned long attente=get_reorder_hold();
+
+    delivrer();
+    while (tolerance>0 && nb_gardes>0 && !garde(num_aquisition)){
+        // Premier PDU gardé au-delà du trou : l'attente court depuis son arrivée, pas depuis
+        // celle d'un PDU plus lointain, reçu avant que le trou précédent ne soit sauté
+        unsigned int suivant=num_aquisition+1;
+        while (!garde(suivant)) suivant++;
+        unsigned long apparition=reordre[suivant%TAILLE_REORDRE].arrivee;
+
+        if (maintenant-apparition<attente){
+            timer_arm(socket_local.fd, apparition+attente-maintenant, trou_expire);
+            return;
+        }
+        LOG_DEBUG("Trou expiré : PDU %u à %u sautés", num_aquisition, suivant-1);
+        STATS_ADD(socket_local.fd, holes_skipped, suivant-num_aquisition);
+        num_aquisition=suivant;
+        delivrer();
+    }
+}
+
+/*
+ * Echéance de l'attente d'un trou (timer du cœur)
+ */
+static void trou_expire(int socket)
+{
+    pthread_mutex_lock(&verrou_reordre);
+    sauter_trous();
+    pthread_mutex_unlock(&verrou_reordre);
+}
 
 /*
  * Permet de créer un socket entre l’application et MIC-TCP
  * Retourne le descripteur du socket ou bien -1 en cas d'erreur
  */
-int mic_tcp_socket(start_mode sm)
+static int v3_socket(start_mode sm)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
    
     if(initialize_components(sm)==-1){
-       printf("Erreur initialise components \n");
+       LOG_ERROR("Erreur initialise components");
     }
     set_loss_rate(LOSS_RATE);
+    rto_init(&rto);
+    loss_budget_init(&pertes, tolerance, FENETRE_PERTES);
 
-    socket_local.fd=1;
+    if (socket_local.fd==-1) socket_local.fd=socket_alloc(); // Un second socket de cette version reprend le premier
     socket_local.state=IDLE; // Non défini
+    stats_rto(socket_local.fd, &rto);
 
     return socket_local.fd;
 }
@@ -48,49 +226,115 @@ int mic_tcp_socket(start_mode sm)
  * Permet d’attribuer une adresse à un socket.
  * Retourne 0 si succès, et -1 en cas d’échec
  */
-int mic_tcp_bind(int socket, mic_tcp_sock_addr addr)
+static int v3_bind(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return 0;
 }
 
 /*
  * Met le socket en état d'acceptation de connexions
- * Retourne 0 si succès, -1 si erreur
+ * Retourne le socket de la connexion (ici le socket lui-même : une seule connexion), -1 si erreur
  */
-int mic_tcp_accept(int socket, mic_tcp_sock_addr* addr)
+static int v3_accept(int socket, mic_tcp_sock_addr* addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
-    return 0;
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    // Attente de la fin de la poignée de main (gérée par process_received_PDU)
+    pthread_mutex_lock(&verrou_connexion);
+    while (socket_local.state!=ESTABLISHED){
+        pthread_cond_wait(&cond_connexion, &verrou_connexion);
+    }
+    pthread_mutex_unlock(&verrou_connexion);
+
+    loss_budget_init(&pertes, tolerance, FENETRE_PERTES);
+    LOG_INFO("Connexion établie, pertes tolérées : %d%%", tolerance);
+    return socket_local.fd;
 }
 
 /*
  * Permet de réclamer l’établissement d’une connexion
  * Retourne 0 si la connexion est établie, et -1 en cas d’échec
  */
-int mic_tcp_connect(int socket, mic_tcp_sock_addr addr)
+static int v3_connect(int socket, mic_tcp_sock_addr addr)
 {
-    printf("[MIC-TCP] Appel de la fonction: ");  printf(__FUNCTION__); printf("\n");
-    socket_local.state=ESTABLISHED;
-    return 0;
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    unsigned char proposition=tolerance;
+    char accepte;
+
+    /* SYN portant le % de pertes proposé */
+    mic_tcp_pdu syn;
+    preparer_controle(&syn, 1, 0, 0);
+    syn.header.dest_port=addr.port;
+    syn.payload.data=(char*)&proposition;
+    syn.payload.size=1;
+
+    mic_tcp_pdu syn_ack;
+    syn_ack.payload.data=&accepte;
+
+    socket_local.state=SYN_SENT;
+    for (int essai=0; essai<MAX_ESSAIS_CONNEXION; essai++){
+        unsigned long date_envoi=get_now_time_usec();
+        if (IP_send(syn, addr)==-1){
+            LOG_ERROR("Erreur d'envoi du SYN");
+            return -1;
+        }
+        STATS_ADD(socket_local.fd, pdu_sent, 1);
+
+        syn_ack.payload.size=1;
+        if (IP_recv_us(&syn_ack, NULL, rto_get(&rto))==-1){
+            LOG_DEBUG("Timer expiré : renvoi du SYN");
+            rto_backoff(&rto);
+            stats_rto(socket_local.fd, &rto);
+            STATS_ADD(socket_local.fd, timeouts, 1);
+            continue;
+        }
+        STATS_ADD(socket_local.fd, pdu_received, 1);
+        if (!syn_ack.header.syn || !syn_ack.header.ack || syn_ack.payload.size<1) continue;
+
+        rto_ack(&rto, get_now_time_usec()-date_envoi, essai>0);
+        stats_rto(socket_local.fd, &rto);
+        tolerance=(unsigned char)accepte; // Le serveur a pu diminuer notre proposition
+
+        /* ACK final : s'il est perdu, le premier message établira la connexion */
+        mic_tcp_pdu ack;
+        preparer_controle(&ack, 0, 1, 0);
+        ack.header.dest_port=addr.port;
+        if (IP_send(ack, addr)!=-1){
+            STATS_ADD(socket_local.fd, pdu_sent, 1);
+            STATS_ADD(socket_local.fd, acks_sent, 1);
+        }
+
+        connexion_etablie(); // Réveille aussi mic_tcp_accept si le serveur partage ce processus (simulateur)
+        loss_budget_init(&pertes, tolerance, FENETRE_PERTES);
+        LOG_INFO("Connexion établie, pertes tolérées : %d%%", tolerance);
+        return 0;
+    }
+
+    socket_local.state=CLOSED;
+    return -1;
 }
 
 /*
  * Permet de réclamer l’envoi d’une donnée applicative
  * Retourne la taille des données envoyées, et -1 en cas d'erreur
  */
-int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
+static int v3_send(int mic_sock, char* mesg, int mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     // Vérifier qu'on est connecté
-    if (socket_local.state!=ESTABLISHED) printf("Erreur : Connection non établie \n");     
+    if (socket_local.state!=ESTABLISHED) LOG_ERROR("Erreur : Connection non établie");
     
     /* Encapsulation du message */
     mic_tcp_pdu pdu;
         // Header
+    pdu.header.source_port=socket_local.addr.port;
+    pdu.header.dest_port=0;
     pdu.header.seq_num=num_sequence;
     pdu.header.ack_num=num_sequence;
+    pdu.header.timestamp=get_now_time_usec(); // Date de soumission, pour la latence de remise
     pdu.header.syn=0;
     pdu.header.ack=0;
     pdu.header.fin=0;
@@ -101,39 +345,62 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
     /* Création du pdu servant à recupérer l'ack */
     mic_tcp_pdu pdu_ack;
     pdu_ack.payload.size=0;
-    pdu_ack.header.ack_num=num_sequence;
 
     /* Attente de l'ACK */
     int sent_size;  // Taille du paquet envoyé
-    compt_env++; // Incrémente le compteur d'envois
+    int nb_envois=0; // Nombre d'envois de ce message
+    unsigned long date_envoi=0; // Date du dernier envoi en µs
+    unsigned long premier_envoi=0; // Date du premier envoi en µs
+
+    int recu=0; // 1 une fois l'ack de ce message reçu
 
-    while(pdu_ack.header.ack_num!=(num_sequence+1)){ // Regarde le numero de l'ack change ce numéro change => ack reçu
+    while(!recu){
 
         // Envoi pdu
+        date_envoi=get_now_time_usec();
+        nb_envois++;
+        if (nb_envois==1) premier_envoi=date_envoi;
         sent_size=IP_send(pdu, socket_local.addr);
         if (sent_size==-1){
-            printf("Erreur d'envoi \n");
+            LOG_ERROR("Erreur d'envoi");
             exit(1);
         }
+        STATS_ADD(socket_local.fd, pdu_sent, 1);
+        if (nb_envois>1) STATS_ADD(socket_local.fd, retransmissions, 1);
 
-        // Attente d'expiration du timer ou ack reçu
-        if (IP_recv(&pdu_ack, &socket_local.addr, 10)==-1){ // Timer à 10ms
-            double perte=1-(compt_rec/compt_env); // Taux de perte = Taux d'echecs
-            printf("Timer expiré : paquet perdu \n");
-            if (perte>TOLERANCE){
-                printf(" ->Perte non tolérée : %f > %f \n", perte, 1-TOLERANCE);
-                continue; // On renvoie
-            } else {
-                printf(" ->Perte tolérée : %f <= %f \n", perte, 1-TOLERANCE);
-                break; // On s'arrete ici
+        // Attente de l'ack jusqu'à l'expiration du timer : un ack périmé ne provoque pas de renvoi
+        unsigned long echeance=date_envoi+rto_get(&rto); // Timer adaptatif
+        unsigned long maintenant=date_envoi;
+        while (maintenant<echeance && IP_recv_us(&pdu_ack, &socket_local.addr, echeance-maintenant)!=-1){
+            STATS_ADD(socket_local.fd, pdu_received, 1);
+            if (pdu_ack.header.ack && !pdu_ack.header.syn && pdu_ack.header.ack_num==num_sequence+1){ // Ack recu et bonne valeur
+                LOG_TRACE("Message correctement envoyé et reçu");
+                loss_budget_record(&pertes, 0);
+                // Mesure du RTT, ignorée si le message a été renvoyé (règle de Karn)
+                rto_ack(&rto, get_now_time_usec()-date_envoi, nb_envois>1);
+                stats_rto(socket_local.fd, &rto);
+                stats_ack_latency(socket_local.fd, get_now_time_usec()-premier_envoi);
+                recu=1;
+                break;
             }
-        } else if (pdu_ack.header.ack_num==num_sequence+1){ // Ack recu et bonne valeur
-            printf("Message correctement envoyé et reçu\n");
-            compt_rec++;
-        } // Sinon, cela signifie que l'ack recu est non conforme, on reboucle donc
-        else {
-        printf("Ack recu = %d ", pdu_ack.header.ack_num);
+            // SYN-ACK répété ou ack d'un envoi précédent : on attend encore le bon
+            LOG_TRACE("Ack ignoré = %d", pdu_ack.header.ack_num);
+            maintenant=get_now_time_usec();
+        }
+        if (recu) break;
+
+        LOG_DEBUG("Timer expiré : paquet perdu");
+        rto_backoff(&rto);
+        stats_rto(socket_local.fd, &rto);
+        STATS_ADD(socket_local.fd, timeouts, 1);
+        if (!loss_budget_allows(&pertes)){
+            LOG_DEBUG(" ->Perte non tolérée : déjà %d pertes sur les %d derniers messages", pertes.nb_lost, pertes.window);
+            continue; // On renvoie
         }
+        LOG_DEBUG(" ->Perte tolérée : %d pertes sur les %d derniers messages", pertes.nb_lost, pertes.window);
+        loss_budget_record(&pertes, 1);
+        STATS_ADD(socket_local.fd, tolerated_losses, 1);
+        break; // On s'arrete ici
     }
     // Mise à jour du numéro de séquence
     num_sequence=(num_sequence+1);
@@ -146,16 +413,21 @@ int mic_tcp_send (int mic_sock, char* mesg, int mesg_size)
  * Retourne le nombre d’octets lu ou bien -1 en cas d’erreur
  * NB : cette fonction fait appel à la fonction app_buffer_get()
  */
-int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
+static int v3_recv(int socket, char* mesg, int max_mesg_size)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     
     // Lire le socket 
     mic_tcp_payload payload;
     payload.data = mesg;
     payload.size = max_mesg_size;
-    int read_size = app_buffer_get(payload);
-    
+    int read_size = app_buffer_get(socket_local.fd, payload);
+
+    // Une place vient de se libérer : messages gardés faute de place dans le buffer
+    pthread_mutex_lock(&verrou_reordre);
+    sauter_trous();
+    pthread_mutex_unlock(&verrou_reordre);
+
     return read_size;
 }
 
@@ -164,37 +436,117 @@ int mic_tcp_recv (int socket, char* mesg, int max_mesg_size)
  * Engendre la fermeture de la connexion suivant le modèle de TCP.
  * Retourne 0 si tout se passe bien et -1 en cas d'erreur
  */
-int mic_tcp_close (int socket)
+static int v3_close(int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction :  "); printf(__FUNCTION__); printf("\n");
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
     return -1;
 }
 
+/*
+ * Permet de consulter le timer de retransmission courant du socket
+ * Retourne sa valeur en µs
+ */
+static unsigned long v3_get_rto(int socket)
+{
+    return rto_get(&rto);
+}
+
+/*
+ * Permet de choisir le % de pertes admissibles avant l'établissement de la connexion :
+ * proposé par le client dans mic_tcp_connect, maximum accepté par le serveur
+ * Retourne 0 si succès, -1 en cas d'erreur
+ */
+static int v3_set_loss_tolerance(int socket, unsigned short percent)
+{
+    if (percent>100 || socket_local.state!=IDLE) return -1;
+    tolerance=percent;
+    return 0;
+}
+
+/*
+ * Permet de choisir le délai maximal d'acquittement d'un PDU reçu dans l'ordre (0 : ack immédiat)
+ * Retourne 0 si succès, -1 en cas d'erreur (cette version acquitte chaque PDU aussitôt : seul 0 est possible)
+ */
+static int v3_set_ack_delay(int socket, unsigned long delay_usec)
+{
+    return (delay_usec==0) ? 0 : -1;
+}
+
 /*
  * Traitement d’un PDU MIC-TCP reçu (mise à jour des numéros de séquence
  * et d'acquittement, etc.) puis insère les données utiles du PDU dans
  * le buffer de réception du socket. Cette fonction utilise la fonction
  * app_buffer_put().
  */
-void process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr)
+static void v3_process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
 {
-    printf("[MIC-TCP] Appel de la fonction: "); printf(__FUNCTION__); printf("\n");
-    
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+    STATS_ADD(socket_local.fd, pdu_received, 1);
+
+    /* Etablissement de la connexion */
+    if (pdu.header.syn){
+        repondre_syn(pdu, addr);
+        return;
+    }
+    if (pdu.header.ack){ // ACK final de la poignée de main
+        if (socket_local.state==SYN_RECEIVED) connexion_etablie();
+        return;
+    }
+    if (socket_local.state==SYN_RECEIVED) connexion_etablie(); // ACK final perdu : le message vaut confirmation
+    if (socket_local.state!=ESTABLISHED) return; // Pas de connexion : le message est ignoré
+
     mic_tcp_pdu pdu_ack;
-    pdu_ack.payload.size=0; // Ce pdu ne sert qu'a envoyer l'ack, donc pas de payload
-    
-    // Teste la reception du bon message
-    if (pdu.header.seq_num>=num_aquisition){ // Si j'ai reçu le bon message
-        app_buffer_put(pdu.payload);
-        pdu_ack.header.ack_num=(pdu.header.seq_num+1); // Met à jour l'ack
-        num_aquisition=(pdu.header.seq_num+1); // Met à jour le num attendu
-    } else {
-        pdu_ack.header.ack_num=num_aquisition; // Sinon, met à jour l'ack pour contrer la perte d'ack (j'ai deja recu ce message donc renvoie l'ack d'avant)
+    preparer_controle(&pdu_ack, 0, 1, 0); // Ce pdu ne sert qu'a envoyer l'ack, donc pas de payload
+    pdu_ack.header.dest_port=pdu.header.source_port;
+
+    unsigned int num=pdu.header.seq_num;
+    pdu_ack.header.ack_num=(num+1); // Acquitte le message reçu, même s'il attend un trou
+
+    pthread_mutex_lock(&verrou_reordre);
+    if (num<num_aquisition || (num-num_aquisition<TAILLE_REORDRE && garde(num))){
+        STATS_ADD(socket_local.fd, duplicates, 1); // Déjà reçu : on renvoie l'ack (perte d'ack)
+    } else if (num-num_aquisition>=TAILLE_REORDRE || pdu.payload.size>MAX_DATA_SIZE){
+        pdu_ack.header.ack_num=num_aquisition; // Pas de place pour lui : l'émetteur le renverra
+    } else if (num==num_aquisition && nb_gardes==0
+               && app_buffer_put(socket_local.fd, pdu.payload, pdu.header.timestamp)!=-1){ // Dans l'ordre : délivré sans copie
+        num_aquisition++;
+        STATS_ADD(socket_local.fd, bytes_delivered, pdu.payload.size);
+    } else { // Au-delà d'un trou, ou buffer de réception plein : gardé dans le tampon
+        place* p=&reordre[num%TAILLE_REORDRE];
+        memcpy(p->data, pdu.payload.data, pdu.payload.size);
+        p->size=pdu.payload.size;
+        p->horodatage=pdu.header.timestamp;
+        p->arrivee=get_now_time_usec();
+        marquer(num, 1);
+        nb_gardes++;
+        if (num!=num_aquisition) STATS_ADD(socket_local.fd, reordered, 1);
+        sauter_trous();
     }
+    pthread_mutex_unlock(&verrou_reordre);
 
     if (IP_send(pdu_ack, socket_local.addr)==-1){// Envoi l'ack
-        printf("Erreur dans l'envoi de l'ack \n");
+        LOG_ERROR("Erreur dans l'envoi de l'ack");
         exit(1);
     }
+    STATS_ADD(socket_local.fd, pdu_sent, 1);
+    STATS_ADD(socket_local.fd, acks_sent, 1);
 
 }
+
+/*
+ * Fonctions de cette version, appelées par l'interface (src/mictcp.c)
+ */
+const mic_tcp_policy mictcp_v3={
+    .name="v3",
+    .socket=v3_socket,
+    .bind=v3_bind,
+    .accept=v3_accept,
+    .connect=v3_connect,
+    .send=v3_send,
+    .recv=v3_recv,
+    .close=v3_close,
+    .get_rto=v3_get_rto,
+    .set_loss_tolerance=v3_set_loss_tolerance,
+    .set_ack_delay=v3_set_ack_delay,
+    .process_received_PDU=v3_process_received_PDU
+};
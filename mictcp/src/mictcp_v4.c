@@ -0,0 +1,1166 @@
+/** Version 4 du protocole mictcp :
+ *  Garantie de fiabilité totale via un mécanisme de reprise des pertes
+ *      de type « Selective Repeat » à fenêtre glissante.
+ *
+ *  Jusqu'à WINDOW_SIZE PDU peuvent être en vol sans attendre leur ack, dans la limite de la
+ *      fenêtre de congestion (src/api/mictcp_cc.c : Reno par défaut, ou MICTCP_CC), que font
+ *      évoluer les acks de nouvelles données et les expirations du timer.
+ *      Chaque PDU envoyé est conservé dans la fenêtre d'émission avec sa date d'envoi, et seul
+ *      un PDU perdu (timer expiré ou trou signalé par les acks, voir plus bas) est renvoyé.
+ *      Le timer est estimé à partir du RTT mesuré sur les PDU envoyés une seule fois (règle de Karn).
+ *      mic_tcp_send ne bloque que lorsque la fenêtre est pleine.
+ *
+ *  Le récepteur acquitte les PDU (seq_num de l'ack = dernier PDU acquitté, ack_num = prochain
+ *      numéro attendu), garde les PDU arrivés dans le désordre et les délivre à l'application dès
+ *      que la suite est contiguë. Un PDU reçu dans l'ordre peut attendre son ack au plus delai_ack µs
+ *      (mic_tcp_set_ack_delay, get_ack_delay par défaut) : un seul ack cumulatif couvre alors les
+ *      ACKS_CUMULES PDU suivants. Un PDU dans le désordre, en double ou comblant un trou est acquitté
+ *      aussitôt, et toute annonce de fenêtre emporte l'ack en attente.
+ *      Si les deux côtés l'acceptent (SYN / SYN-ACK), chaque ack porte en données jusqu'à MAX_SACK
+ *      blocs SACK (RFC 2018) : les suites de PDU déjà reçues au-delà de ack_num. L'émetteur les retire
+ *      de sa fenêtre même si leurs acks individuels ont été perdus, et seuls les trous sont renvoyés.
+ *
+ *  Retransmission rapide : un ack qui acquitte un PDU plus récent sans faire avancer ack_num est
+ *      un ack dupliqué. Au seuil_dupliques-ième (get_dupack_threshold), l'émetteur entre en reprise
+ *      rapide : il renvoie aussitôt les trous (PDU non acquittés alors qu'un PDU envoyé après eux l'a été)
+ *      sans attendre le timer, réduit de moitié la fenêtre de congestion, puis renvoie les trous
+ *      révélés par les acks suivants jusqu'à l'acquittement de tout ce qui était en vol.
+ *
+ *  Le % de pertes admissibles est négocié à l'établissement de la connexion (SYN / SYN-ACK),
+ *      0 par défaut. S'il est non nul, un PDU dont le timer expire est abandonné tant que les
+ *      FENETRE_PERTES derniers messages restent sous ce seuil, et chaque PDU de données indique dans ack_num le plus
+ *      petit numéro encore en vol : le récepteur saute alors les PDU abandonnés.
+ *
+ *  Contrôle de flux : chaque PDU annonce dans window le nombre de messages que son émetteur
+ *      peut encore recevoir (places libres de son buffer de réception). L'émetteur n'envoie pas
+ *      au-delà de ack_num+window ; si la fenêtre annoncée est nulle et qu'aucun PDU n'est en vol,
+ *      il envoie périodiquement une sonde (PDU de données vide) à laquelle le récepteur répond par sa fenêtre.
+ *
+ *  Chaque socket porte sa propre connexion : un socket serveur lié à un port reçoit les SYN,
+ *      crée un socket par correspondant et mic_tcp_accept rend ces sockets une fois établis.
+ *      Le cœur aiguille les PDU reçus vers leur socket selon (adresse, port source, port destination).
+ */
+#include <mictcp.h>
+#include <mictcp_policy.h>
+#include <api/mictcp_core.h>
+#include <api/mictcp_rto.h>
+#include <api/mictcp_loss.h>
+
+#define LOSS_RATE 20      // En pourcentage, taux de perte fixé
+#define WINDOW_SIZE 64    // Nombre maximal de PDU en vol, la fenêtre de congestion limitant en deçà
+#define MAX_ESSAIS 100    // Nombre maximal de renvois d'un PDU lors de la fermeture
+#define TOLERANCE 0       // Pertes admises par défaut, en pourcentage
+#define MAX_ESSAIS_CONNEXION 20 // Nombre d'envois du SYN avant abandon
+#define FENETRE_PERTES 20 // Nombre de messages consécutifs sur lesquels porte la tolérance
+#define MAX_ATTENTE 64    // Nombre de connexions établies en attente de mic_tcp_accept
+#define PORT_EPHEMERE 49152 // Premier port local attribué aux clients
+#define BATCH_SIZE 16      // Nombre maximal de datagrammes lus ou envoyés par appel système
+#define MAX_DATA_SIZE (1500 - API_HD_Size) // Taille maximale des données d'un PDU
+#define MAX_SACK 4        // Nombre maximal de blocs SACK portés par un ack
+#define ACKS_CUMULES 2    // PDU reçus dans l'ordre couverts par un ack retardé
+
+/*
+ * Case d'une fenêtre : un PDU et son état
+ */
+typedef struct segment
+{
+    unsigned int seq_num;       // numéro de séquence du PDU
+    char data[MAX_DATA_SIZE];   // copie des données applicatives
+    int size;                   // taille des données
+    unsigned long date_envoi;   // date du dernier envoi en µs
+    unsigned long premier_envoi; // date du premier envoi en µs
+    unsigned int horodatage;    // date de soumission par l'application émettrice (portée par le PDU)
+    int essais;                 // nombre d'envois
+    int occupe;                 // 1 si la case contient un PDU non acquitté (émission) ou non délivré (réception)
+} segment;
+
+/*
+ * Bloc SACK : PDU de numéro debut à fin-1 reçus par le correspondant
+ */
+typedef struct bloc_sack
+{
+    unsigned int debut;
+    unsigned int fin;
+} bloc_sack;
+
+/*
+ * Etat d'une connexion, un par socket
+ */
+typedef struct connexion
+{
+    mic_tcp_sock sock;                  // descripteur, état et adresse locale
+    start_mode mode;                    // client ou serveur
+    mic_tcp_sock_addr distant;          // adresse du correspondant
+    char ip_distant[INET_ADDRSTRLEN];   // copie de l'adresse IP du correspondant
+
+    /* Protège l'émission (fenêtres d'émission et de congestion, timer, reprise) : les acks
+       des clients arrivent sur un même socket système, lus par n'importe quel thread qui envoie */
+    pthread_mutex_t verrou_envoi;
+
+    /* Fenêtre d'émission : PDU de numéro base_env à num_sequence-1 */
+    segment fenetre_env[WINDOW_SIZE];
+    unsigned int base_env;
+    unsigned int num_sequence;
+    unsigned int en_vol;        // PDU de la fenêtre ni acquittés ni abandonnés, limités par la fenêtre de congestion
+
+    /* Contrôle de flux : le correspondant accepte les PDU de numéro inférieur à limite_env */
+    unsigned int limite_env;
+    unsigned int dernier_ack;       // plus grand ack_num reçu, les acks plus anciens ne changent pas la limite
+    unsigned long date_sonde;       // date de la dernière sonde de fenêtre nulle
+    int fenetre_nulle;              // 1 si une fenêtre nulle a été annoncée et pas encore rouverte (accès __atomic)
+
+    mic_tcp_rto rto; // Estimation du timer de retransmission
+    mic_tcp_cc cc;   // Fenêtre de congestion
+
+    /* Retransmission rapide */
+    unsigned short seuil_dupliques; // acks dupliqués déclenchant la reprise, 0 : timer seul
+    unsigned int acks_dupliques;    // acks dupliqués reçus depuis la dernière avance de ack_num
+    unsigned long date_acquittee;   // dernier PDU envoyé parmi ceux acquittés et envoyés une seule fois : date d'envoi
+    unsigned int num_acquitte;      // et son numéro (départage les PDU envoyés à la même date)
+    int en_reprise;                 // 1 pendant une reprise rapide
+    unsigned int fin_reprise;       // la reprise s'achève quand ack_num atteint ce numéro
+    unsigned long debut_reprise;    // date d'entrée en reprise : les trous envoyés avant sont à renvoyer
+
+    unsigned short tolerance; // Pertes admises : proposées (client) ou maximales (serveur), puis négociées
+    loss_budget pertes; // Pertes sur les derniers messages envoyés
+    int sack;           // 1 si les acks portent des blocs SACK : proposé (get_sack), puis négocié
+
+    /* Fenêtre de réception : PDU de numéro base_rec à base_rec+WINDOW_SIZE-1 */
+    segment fenetre_rec[WINDOW_SIZE];
+    unsigned int base_rec;
+
+    /* Acks retardés */
+    unsigned long delai_ack;    // attente maximale de l'ack d'un PDU reçu dans l'ordre en µs, 0 : ack immédiat
+    unsigned int acks_retardes; // PDU reçus dans l'ordre et pas encore acquittés
+    unsigned int num_retarde;   // dernier d'entre eux, désigné par seq_num de l'ack à venir
+    unsigned long echeance_ack; // date à laquelle cet ack doit partir
+
+    /* Socket en écoute : connexions établies pas encore rendues par mic_tcp_accept */
+    int ecoute;                 // 1 si le socket est en écoute
+    int attente[MAX_ATTENTE];
+    int debut_attente;
+    int nb_attente;
+    int parent;                 // socket en écoute ayant créé la connexion, -1 sinon
+} connexion;
+
+static connexion* connexions[MAX_SOCKETS];
+
+/* Protège la table des connexions et l'attente des connexions par mic_tcp_accept */
+static pthread_mutex_t verrou_connexion=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_connexion=PTHREAD_COND_INITIALIZER;
+
+/*
+ * Retourne la connexion d'un socket, NULL si le descripteur est invalide
+ */
+static connexion* trouver(int socket)
+{
+    if (socket<0 || socket>=MAX_SOCKETS) return NULL;
+    return connexions[socket];
+}
+
+/*
+ * Crée la connexion d'un nouveau socket et l'enregistre dans la table.
+ * Appelée avec verrou_connexion pris.
+ * Retourne la connexion, ou NULL si plus aucun socket n'est disponible
+ */
+static connexion* creer_connexion(start_mode sm, unsigned short tolerance, int parent)
+{
+    int fd=socket_alloc();
+    if (fd==-1) return NULL;
+
+    connexion* c=calloc(1, sizeof(connexion));
+    pthread_mutex_init(&c->verrou_envoi, NULL);
+    c->sock.fd=fd;
+    c->sock.state=IDLE; // Non défini
+    c->mode=sm;
+    c->tolerance=tolerance;
+    c->parent=parent;
+    c->limite_env=WINDOW_SIZE; // Jusqu'à la première annonce du correspondant
+    rto_init(&c->rto);
+    stats_rto(fd, &c->rto);
+    cc_init(&c->cc, NULL, fd);
+    c->sack=get_sack();
+    c->seuil_dupliques=get_dupack_threshold();
+    c->delai_ack=get_ack_delay();
+    loss_budget_init(&c->pertes, c->tolerance, FENETRE_PERTES);
+
+    connexions[fd]=c;
+    return c;
+}
+
+/*
+ * Retire la connexion de la table et de l'aiguillage, puis libère son socket.
+ * Appelée sans verrou_envoi pris : on attend qu'un autre thread ait fini d'y traiter un ack.
+ */
+static void detruire_connexion(connexion* c)
+{
+    int fd=c->sock.fd;
+
+    if (c->ecoute){
+        mic_tcp_sock_addr tous={"0.0.0.0", 8, 0};
+        demux_remove(tous, c->sock.addr.port);
+    } else if (c->distant.ip_addr!=NULL){
+        demux_remove(c->distant, c->sock.addr.port);
+    }
+
+    pthread_mutex_lock(&verrou_connexion);
+    connexions[fd]=NULL;
+    pthread_mutex_unlock(&verrou_connexion);
+
+    pthread_mutex_lock(&c->verrou_envoi);
+    pthread_mutex_unlock(&c->verrou_envoi);
+    pthread_mutex_destroy(&c->verrou_envoi);
+    free(c);
+    socket_free(fd);
+}
+
+/*
+ * Mémorise l'adresse du correspondant (la chaîne reçue n'est valable que temporairement)
+ */
+static void fixer_distant(connexion* c, mic_tcp_sock_addr addr)
+{
+    strncpy(c->ip_distant, addr.ip_addr, sizeof(c->ip_distant)-1);
+    c->distant.ip_addr=c->ip_distant;
+    c->distant.ip_addr_size=strlen(c->ip_distant)+1;
+    c->distant.port=addr.port;
+}
+
+/*
+ * Nombre de messages que l'on peut encore recevoir, annoncé dans chaque PDU envoyé.
+ * Une fenêtre nulle est retenue jusqu'à ce que mic_tcp_recv en annonce la réouverture.
+ */
+static unsigned short fenetre_annoncee(connexion* c)
+{
+    unsigned int libre=app_buffer_free(c->sock.fd);
+
+    if (libre==0) __atomic_store_n(&c->fenetre_nulle, 1, __ATOMIC_SEQ_CST);
+    return (libre>0xFFFF) ? 0xFFFF : libre;
+}
+
+/*
+ * Prépare un PDU de contrôle (sans données) avec les flags donnés
+ */
+static void preparer_controle(connexion* c, mic_tcp_pdu* pdu, unsigned char syn, unsigned char ack, unsigned int ack_num)
+{
+    pdu->header.source_port=c->sock.addr.port;
+    pdu->header.dest_port=c->distant.port;
+    pdu->header.seq_num=0;
+    pdu->header.ack_num=ack_num;
+    pdu->header.timestamp=0;
+    pdu->header.window=fenetre_annoncee(c);
+    pdu->header.syn=syn;
+    pdu->header.ack=ack;
+    pdu->header.fin=0;
+    pdu->payload.data=NULL;
+    pdu->payload.size=0;
+}
+
+/*
+ * Passage en état ESTABLISHED côté serveur : la connexion est confiée
+ * au socket en écoute pour mic_tcp_accept.
+ * Appelée avec verrou_connexion pris.
+ */
+static void connexion_etablie(connexion* c)
+{
+    connexion* l=trouver(c->parent);
+
+    c->sock.state=ESTABLISHED;
+    loss_budget_init(&c->pertes, c->tolerance, FENETRE_PERTES);
+
+    if (l!=NULL && l->nb_attente<MAX_ATTENTE){
+        l->attente[(l->debut_attente+l->nb_attente)%MAX_ATTENTE]=c->sock.fd;
+        l->nb_attente++;
+        pthread_cond_broadcast(&cond_connexion);
+    }
+}
+
+/*
+ * Réponse à un SYN : retient le minimum entre le % de pertes proposé et le nôtre,
+ * puis le renvoie dans un SYN-ACK (un SYN répété reçoit la même réponse).
+ * Appelée avec verrou_connexion pris.
+ */
+static void repondre_syn(connexion* c, mic_tcp_pdu pdu)
+{
+    unsigned char proposition=(pdu.payload.size>=1) ? (unsigned char)pdu.payload.data[0] : 0;
+
+    if (proposition<c->tolerance) c->tolerance=proposition;
+    if (pdu.payload.size<2 || !pdu.payload.data[1]) c->sack=0; // SACK non proposé
+    if (c->sock.state!=ESTABLISHED) c->sock.state=SYN_RECEIVED;
+    c->limite_env=pdu.header.window;
+    unsigned char accepte[2]={c->tolerance, c->sack};
+
+    mic_tcp_pdu syn_ack;
+    preparer_controle(c, &syn_ack, 1, 1, 0);
+    syn_ack.payload.data=(char*)accepte;
+    syn_ack.payload.size=sizeof(accepte);
+    if (IP_send(syn_ack, c->distant)==-1){
+        LOG_ERROR("Erreur dans l'envoi du SYN-ACK");
+        return;
+    }
+    STATS_ADD(c->sock.fd, pdu_sent, 1);
+}
+
+/*
+ * SYN reçu par un socket en écoute : création du socket de la connexion,
+ * enregistré auprès du cœur pour les PDU suivants du correspondant.
+ * Appelée avec verrou_connexion pris.
+ */
+static void nouvelle_connexion(connexion* l, mic_tcp_pdu pdu, mic_tcp_sock_addr addr)
+{
+    connexion* c=creer_connexion(SERVER, l->tolerance, l->sock.fd);
+    if (c==NULL){
+        LOG_ERROR("Erreur : plus de socket disponible");
+        return;
+    }
+
+    c->delai_ack=l->delai_ack;
+    c->sock.addr=l->sock.addr;
+    fixer_distant(c, addr);
+    demux_add(c->distant, c->sock.addr.port, c->sock.fd);
+    repondre_syn(c, pdu);
+}
+
+/*
+ * Place dans les données de l'ack les blocs SACK des PDU gardés dans la fenêtre de réception,
+ * dans l'ordre des numéros : les premiers blocs bornent les trous les plus anciens.
+ * Appelée avec verrou_connexion pris.
+ */
+static void ajouter_sack(connexion* c, mic_tcp_pdu* pdu_ack, bloc_sack* blocs)
+{
+    unsigned int num=c->base_rec;
+    unsigned int fin_fenetre=c->base_rec+WINDOW_SIZE;
+    int nb_blocs=0;
+
+    while (c->sack && num<fin_fenetre && nb_blocs<MAX_SACK){
+        if (!c->fenetre_rec[num%WINDOW_SIZE].occupe){
+            num++;
+            continue;
+        }
+        blocs[nb_blocs].debut=num;
+        while (num<fin_fenetre && c->fenetre_rec[num%WINDOW_SIZE].occupe) num++;
+        blocs[nb_blocs].fin=num;
+        nb_blocs++;
+    }
+
+    pdu_ack->payload.data=(char*)blocs;
+    pdu_ack->payload.size=nb_blocs*sizeof(bloc_sack);
+}
+
+/*
+ * Ack sans PDU acquitté (seq_num = dernier PDU délivré), qui ne sert qu'à annoncer notre fenêtre.
+ * Appelée avec verrou_connexion pris.
+ */
+static void annoncer_fenetre(connexion* c)
+{
+    mic_tcp_pdu maj;
+    bloc_sack blocs[MAX_SACK];
+    preparer_controle(c, &maj, 0, 1, c->base_rec);
+    maj.header.seq_num=c->base_rec-1;
+    ajouter_sack(c, &maj, blocs);
+    if (IP_send(maj, c->distant)!=-1){
+        STATS_ADD(c->sock.fd, pdu_sent, 1);
+        STATS_ADD(c->sock.fd, acks_sent, 1);
+    }
+    c->acks_retardes=0; // ack_num couvre aussi les PDU en attente d'ack
+}
+
+/*
+ * Ack du PDU num, cumulatif jusqu'à base_rec, avec les blocs SACK de ceux gardés en attente d'un trou.
+ * Appelée avec verrou_connexion pris.
+ */
+static void envoyer_ack(connexion* c, unsigned int num)
+{
+    mic_tcp_pdu pdu_ack;
+    bloc_sack blocs[MAX_SACK];
+    preparer_controle(c, &pdu_ack, 0, 1, c->base_rec);
+    pdu_ack.header.seq_num=num;
+    ajouter_sack(c, &pdu_ack, blocs);
+
+    if (IP_send(pdu_ack, c->distant)==-1){ // Envoi l'ack
+        LOG_ERROR("Erreur dans l'envoi de l'ack");
+        exit(1);
+    }
+    STATS_ADD(c->sock.fd, pdu_sent, 1);
+    STATS_ADD(c->sock.fd, acks_sent, 1);
+    c->acks_retardes=0;
+}
+
+/*
+ * Expiration du délai d'un ack retardé (timer du cœur) : l'ack part s'il est toujours attendu
+ */
+static void ack_retarde(int socket)
+{
+    pthread_mutex_lock(&verrou_connexion);
+    connexion* c=trouver(socket);
+    if (c!=NULL && c->acks_retardes>0){
+        unsigned long maintenant=get_now_time_usec();
+        if (maintenant>=c->echeance_ack) envoyer_ack(c, c->num_retarde);
+        else timer_arm(socket, c->echeance_ack-maintenant, ack_retarde); // Réveil d'un ack précédent
+    }
+    pthread_mutex_unlock(&verrou_connexion);
+}
+
+/*
+ * Vrai si la fenêtre de réception garde des PDU arrivés dans le désordre.
+ * Appelée avec verrou_connexion pris.
+ */
+static int en_attente(connexion* c)
+{
+    for (unsigned int num=c->base_rec; num<c->base_rec+WINDOW_SIZE; num++){
+        if (c->fenetre_rec[num%WINDOW_SIZE].occupe) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Délivre à l'application la suite contiguë de la fenêtre de réception,
+ * tant que le buffer de réception du socket a de la place.
+ * Appelée avec verrou_connexion pris.
+ */
+static void delivrer(connexion* c)
+{
+    while (c->fenetre_rec[c->base_rec%WINDOW_SIZE].occupe){
+        segment* seg=&c->fenetre_rec[c->base_rec%WINDOW_SIZE];
+        mic_tcp_payload payload;
+        payload.data=seg->data;
+        payload.size=seg->size;
+        if (app_buffer_put(c->sock.fd, payload, seg->horodatage)==-1) return; // Plein : mic_tcp_recv reprendra
+        STATS_ADD(c->sock.fd, bytes_delivered, seg->size);
+        seg->occupe=0;
+        c->base_rec++;
+    }
+}
+
+/*
+ * Envoie (ou renvoie) le PDU stocké dans une case de la fenêtre d'émission
+ * Retourne la taille envoyée, -1 en cas d'erreur
+ */
+static int envoyer_segment(connexion* c, segment* seg)
+{
+    mic_tcp_pdu pdu;
+    pdu.header.source_port=c->sock.addr.port;
+    pdu.header.dest_port=c->distant.port;
+    pdu.header.seq_num=seg->seq_num;
+    pdu.header.ack_num=c->base_env;
+    pdu.header.timestamp=seg->horodatage;
+    pdu.header.window=fenetre_annoncee(c);
+    pdu.header.syn=0;
+    pdu.header.ack=0;
+    pdu.header.fin=0;
+    pdu.payload.data=seg->data;
+    pdu.payload.size=seg->size;
+
+    seg->date_envoi=get_now_time_usec();
+    if (seg->essais==0) seg->premier_envoi=seg->date_envoi;
+    seg->essais++;
+    int sent_size=IP_send(pdu, c->distant);
+    if (sent_size!=-1){
+        STATS_ADD(c->sock.fd, pdu_sent, 1);
+        if (seg->essais>1) STATS_ADD(c->sock.fd, retransmissions, 1);
+    }
+    return sent_size;
+}
+
+/*
+ * Fait avancer base_env jusqu'au premier PDU encore en vol
+ */
+static void glisser_fenetre(connexion* c)
+{
+    while (c->base_env<c->num_sequence && !c->fenetre_env[c->base_env%WINDOW_SIZE].occupe){
+        c->base_env++;
+    }
+}
+
+/*
+ * Le correspondant a reçu le PDU de la case : il quitte la fenêtre d'émission
+ */
+static void acquitter(connexion* c, segment* seg)
+{
+    stats_ack_latency(c->sock.fd, get_now_time_usec()-seg->premier_envoi);
+    loss_budget_record(&c->pertes, 0);
+    seg->occupe=0;
+    c->en_vol--;
+    if (seg->essais>1) return; // L'ack peut répondre au premier envoi : il ne date rien (règle de Karn)
+    if (seg->date_envoi>c->date_acquittee || (seg->date_envoi==c->date_acquittee && seg->seq_num>c->num_acquitte)){
+        c->date_acquittee=seg->date_envoi;
+        c->num_acquitte=seg->seq_num;
+    }
+}
+
+/*
+ * Renvoie (ou abandonne, si la perte est tolérée) les trous de la fenêtre d'émission : PDU non
+ * acquittés alors qu'un PDU envoyé après eux l'a été, pas encore renvoyés depuis l'entrée en reprise
+ */
+static void renvoyer_trous(connexion* c)
+{
+    unsigned int num;
+
+    for (num=c->base_env; num<c->num_sequence; num++){
+        segment* seg=&c->fenetre_env[num%WINDOW_SIZE];
+        if (!seg->occupe || seg->date_envoi>=c->debut_reprise) continue;
+        if (seg->date_envoi>c->date_acquittee || (seg->date_envoi==c->date_acquittee && num>c->num_acquitte)) continue;
+
+        if (loss_budget_allows(&c->pertes)){
+            LOG_DEBUG("Acks dupliqués : perte tolérée du PDU %u", seg->seq_num);
+            loss_budget_record(&c->pertes, 1);
+            STATS_ADD(c->sock.fd, tolerated_losses, 1);
+            seg->occupe=0;
+            c->en_vol--;
+            continue;
+        }
+        LOG_DEBUG("Acks dupliqués : renvoi rapide du PDU %u", seg->seq_num);
+        if (envoyer_segment(c, seg)==-1){
+            LOG_ERROR("Erreur d'envoi");
+            exit(1);
+        }
+        STATS_ADD(c->sock.fd, fast_retransmits, 1);
+    }
+}
+
+/*
+ * Compte les acks dupliqués (ack_num inchangé alors qu'un PDU plus récent a été reçu) et
+ * entre en reprise rapide au seuil ; en reprise, renvoie les trous révélés par chaque ack
+ */
+static void reprise_rapide(connexion* c, unsigned int ack_num, unsigned int ack_precedent, unsigned int acquittes)
+{
+    if (c->en_reprise && ack_num>=c->fin_reprise){ // Tout ce qui était en vol à l'entrée est acquitté
+        c->en_reprise=0;
+        c->acks_dupliques=0;
+    }
+    if (ack_num>ack_precedent) c->acks_dupliques=0;
+    else if (ack_num==ack_precedent && acquittes>0 && c->base_env<c->num_sequence) c->acks_dupliques++;
+
+    if (!c->en_reprise){
+        if (c->seuil_dupliques==0 || c->acks_dupliques<c->seuil_dupliques) return;
+        c->en_reprise=1;
+        c->fin_reprise=c->num_sequence;
+        c->debut_reprise=get_now_time_usec();
+        cc_loss(&c->cc, c->num_sequence-c->base_env);
+    }
+    renvoyer_trous(c);
+}
+
+/*
+ * Prise en compte d'un ack : acquitte le PDU désigné par seq_num, tous ceux
+ * précédant ack_num et ceux de ses blocs SACK, puis fait glisser la fenêtre d'émission.
+ * Appelée avec verrou_envoi pris.
+ */
+static void traiter_ack(connexion* c, mic_tcp_pdu* pdu_ack)
+{
+    unsigned int num;
+    unsigned int acquittes=0;    // PDU acquittés par cet ack
+    unsigned long echantillon=0; // RTT mesuré, 0 si le PDU a été renvoyé
+    unsigned int ack_precedent=c->dernier_ack;
+    bloc_sack* blocs=(bloc_sack*)pdu_ack->payload.data;
+    int nb_blocs=c->sack ? pdu_ack->payload.size/(int)sizeof(bloc_sack) : 0;
+
+    if (!pdu_ack->header.ack || pdu_ack->header.syn) return; // SYN-ACK répété : ignoré
+
+    // Ack sélectif
+    num=pdu_ack->header.seq_num;
+    if (num>=c->base_env && num<c->num_sequence && c->fenetre_env[num%WINDOW_SIZE].occupe){
+        segment* seg=&c->fenetre_env[num%WINDOW_SIZE];
+        // Mesure du RTT, ignorée si le PDU a été renvoyé (règle de Karn)
+        unsigned long rtt=get_now_time_usec()-seg->date_envoi;
+        rto_ack(&c->rto, rtt, seg->essais>1);
+        if (seg->essais==1) echantillon=rtt;
+        stats_rto(c->sock.fd, &c->rto);
+        acquitter(c, seg);
+        acquittes++;
+    }
+
+    // Ack cumulatif : tout ce qui précède ack_num a été reçu
+    for (num=c->base_env; num<pdu_ack->header.ack_num && num<c->num_sequence; num++){
+        if (c->fenetre_env[num%WINDOW_SIZE].occupe){
+            acquitter(c, &c->fenetre_env[num%WINDOW_SIZE]);
+            acquittes++;
+        }
+    }
+
+    // Blocs SACK : PDU déjà reçus au-delà de ack_num, dont l'ack individuel a pu se perdre
+    for (int i=0; i<nb_blocs; i++){
+        num=(blocs[i].debut>c->base_env) ? blocs[i].debut : c->base_env;
+        for (; num<blocs[i].fin && num<c->num_sequence; num++){
+            if (c->fenetre_env[num%WINDOW_SIZE].occupe){
+                acquitter(c, &c->fenetre_env[num%WINDOW_SIZE]);
+                STATS_ADD(c->sock.fd, sacked, 1);
+                acquittes++;
+            }
+        }
+    }
+
+    // Fenêtre annoncée par le récepteur
+    if (pdu_ack->header.ack_num>=c->dernier_ack){
+        c->dernier_ack=pdu_ack->header.ack_num;
+        c->limite_env=pdu_ack->header.ack_num+pdu_ack->header.window;
+    }
+
+    if (acquittes>0 && !c->en_reprise) cc_ack(&c->cc, acquittes, echantillon);
+    reprise_rapide(c, pdu_ack->header.ack_num, ack_precedent, acquittes);
+    glisser_fenetre(c);
+}
+
+/*
+ * Vrai si un nouveau PDU peut partir : place dans la fenêtre d'émission, dans la fenêtre
+ * de congestion (les PDU déjà acquittés au-delà d'un trou n'y comptent plus) et dans la
+ * fenêtre annoncée par le récepteur
+ */
+static int envoi_possible(connexion* c)
+{
+    return c->num_sequence-c->base_env<WINDOW_SIZE && c->en_vol<cc_window(&c->cc) && c->num_sequence<c->limite_env;
+}
+
+/*
+ * Fenêtre nulle sans PDU en vol : aucun ack ne viendra la rouvrir, on sonde le
+ * récepteur à chaque expiration du timer (doublé à chaque sonde).
+ * Appelée avec verrou_envoi pris.
+ */
+static void sonder(connexion* c)
+{
+    unsigned long maintenant=get_now_time_usec();
+
+    if (c->base_env!=c->num_sequence || maintenant-c->date_sonde<rto_get(&c->rto)) return;
+
+    mic_tcp_pdu sonde;
+    preparer_controle(c, &sonde, 0, 0, c->base_env); // PDU de données vide
+    sonde.header.seq_num=c->num_sequence;
+    LOG_DEBUG("Fenêtre nulle : sonde du récepteur");
+    if (IP_send(sonde, c->distant)!=-1) STATS_ADD(c->sock.fd, pdu_sent, 1);
+
+    c->date_sonde=maintenant;
+    rto_backoff(&c->rto);
+    stats_rto(c->sock.fd, &c->rto);
+}
+
+/*
+ * Lit les acks reçus : attend au plus attente µs le premier,
+ * puis récupère sans attendre ceux déjà arrivés.
+ * Chaque ack est rendu à la connexion à laquelle il est destiné, sous son verrou_envoi.
+ * Appelée sans verrou_envoi pris, l'ack pouvant être celui d'une autre connexion.
+ * Retourne le nombre d'acks lus
+ */
+static int recevoir_acks(unsigned long attente)
+{
+    mic_tcp_pdu pdu_ack;
+    mic_tcp_sock_addr addr;
+    bloc_sack blocs[MAX_SACK];
+    int nb_acks=0;
+
+    pdu_ack.payload.data=(char*)blocs;
+    pdu_ack.payload.size=sizeof(blocs);
+    while (IP_recv_us(&pdu_ack, &addr, attente)!=-1){
+        // La connexion est verrouillée avant de quitter la table : detruire_connexion attend la fin du traitement
+        pthread_mutex_lock(&verrou_connexion);
+        connexion* c=trouver(demux_lookup(&pdu_ack, &addr));
+        if (c!=NULL) pthread_mutex_lock(&c->verrou_envoi);
+        pthread_mutex_unlock(&verrou_connexion);
+        if (c!=NULL){
+            STATS_ADD(c->sock.fd, pdu_received, 1);
+            traiter_ack(c, &pdu_ack);
+            pthread_mutex_unlock(&c->verrou_envoi);
+        }
+        nb_acks++;
+        attente=0;
+        pdu_ack.payload.size=sizeof(blocs);
+    }
+    return nb_acks;
+}
+
+/*
+ * Renvoie (ou abandonne, si la perte est tolérée) les PDU de la fenêtre dont le timer a expiré,
+ * puis double le timer et réduit la fenêtre de congestion s'il y en a eu
+ * Retourne le délai en µs avant la prochaine expiration (le timer si aucun PDU en vol),
+ * ou -1 si un PDU a dépassé max_essais envois.
+ * Appelée avec verrou_envoi pris.
+ */
+static long renvoyer_expires(connexion* c, int max_essais)
+{
+    unsigned long maintenant=get_now_time_usec();
+    unsigned long timer=rto_get(&c->rto);
+    long prochain=timer;
+    int expiration=0;
+    unsigned int num;
+
+    IP_send_begin(); // Les renvois partent ensemble
+    for (num=c->base_env; num<c->num_sequence; num++){
+        segment* seg=&c->fenetre_env[num%WINDOW_SIZE];
+        if (!seg->occupe) continue;
+
+        if (maintenant-seg->date_envoi>=timer){
+            expiration=1;
+            STATS_ADD(c->sock.fd, timeouts, 1);
+            if (loss_budget_allows(&c->pertes)){
+                LOG_DEBUG("Timer expiré : perte tolérée du PDU %u", seg->seq_num);
+                loss_budget_record(&c->pertes, 1);
+                STATS_ADD(c->sock.fd, tolerated_losses, 1);
+                seg->occupe=0;
+                c->en_vol--;
+                continue;
+            }
+            if (max_essais>0 && seg->essais>=max_essais){
+                IP_send_flush();
+                return -1;
+            }
+            LOG_DEBUG("Timer expiré : renvoi du PDU %u", seg->seq_num);
+            if (envoyer_segment(c, seg)==-1){
+                LOG_ERROR("Erreur d'envoi");
+                exit(1);
+            }
+            maintenant=seg->date_envoi;
+        } else if ((long)(seg->date_envoi+timer-maintenant)<prochain){
+            prochain=seg->date_envoi+timer-maintenant;
+        }
+    }
+
+    IP_send_flush();
+
+    if (expiration){
+        c->en_reprise=0; // Le timer reprend la main
+        c->acks_dupliques=0;
+        cc_timeout(&c->cc, c->num_sequence-c->base_env);
+        rto_backoff(&c->rto);
+        stats_rto(c->sock.fd, &c->rto);
+    }
+    glisser_fenetre(c);
+    return prochain;
+}
+
+/*
+ * Permet de créer un socket entre l’application et MIC-TCP
+ * Retourne le descripteur du socket ou bien -1 en cas d'erreur
+ */
+static int v4_socket(start_mode sm)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    if(initialize_components(sm)==-1){
+        LOG_ERROR("Erreur initialise components");
+        return -1;
+    }
+    set_loss_rate(LOSS_RATE);
+    set_batch_size(BATCH_SIZE);
+
+    pthread_mutex_lock(&verrou_connexion);
+    connexion* c=creer_connexion(sm, TOLERANCE, -1);
+    pthread_mutex_unlock(&verrou_connexion);
+    if (c==NULL){
+        LOG_ERROR("Erreur : plus de socket disponible");
+        return -1;
+    }
+
+    return c->sock.fd;
+}
+
+/*
+ * Permet d’attribuer une adresse à un socket.
+ * Un socket serveur se met alors en écoute des SYN adressés à ce port.
+ * Retourne 0 si succès, et -1 en cas d’échec
+ */
+static int v4_bind(int socket, mic_tcp_sock_addr addr)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* c=trouver(socket);
+    if (c==NULL) return -1;
+
+    c->sock.addr=addr;
+    if (c->mode==SERVER){
+        c->ecoute=1;
+        return demux_listen(addr.port, socket);
+    }
+    return 0;
+}
+
+/*
+ * Met le socket en état d'acceptation de connexions
+ * Retourne le socket de la prochaine connexion établie, -1 si erreur
+ */
+static int v4_accept(int socket, mic_tcp_sock_addr* addr)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* l=trouver(socket);
+    if (l==NULL || !l->ecoute) return -1;
+
+    // Attente de la fin d'une poignée de main (gérée par process_received_PDU)
+    pthread_mutex_lock(&verrou_connexion);
+    while (l->nb_attente==0){
+        pthread_cond_wait(&cond_connexion, &verrou_connexion);
+    }
+    connexion* c=connexions[l->attente[l->debut_attente]];
+    l->debut_attente=(l->debut_attente+1)%MAX_ATTENTE;
+    l->nb_attente--;
+    pthread_mutex_unlock(&verrou_connexion);
+
+    if (addr!=NULL) *addr=c->distant;
+    LOG_INFO("Connexion établie, pertes tolérées : %d%%", c->tolerance);
+    return c->sock.fd;
+}
+
+/*
+ * Permet de réclamer l’établissement d’une connexion
+ * Retourne 0 si la connexion est établie, et -1 en cas d’échec
+ */
+static int v4_connect(int socket, mic_tcp_sock_addr addr)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* c=trouver(socket);
+    if (c==NULL) return -1;
+
+    // Port local attribué d'office, distinct entre processus et entre sockets
+    if (c->sock.addr.port==0){
+        c->sock.addr.port=PORT_EPHEMERE+(getpid()*MAX_SOCKETS+socket)%(65536-PORT_EPHEMERE);
+    }
+    fixer_distant(c, addr);
+    if (demux_add(c->distant, c->sock.addr.port, socket)==-1){
+        LOG_ERROR("Erreur : adresse inconnue %s", addr.ip_addr);
+        return -1;
+    }
+
+    unsigned char proposition[2]={c->tolerance, c->sack};
+    char accepte[2];
+
+    /* SYN portant le % de pertes proposé et l'offre de SACK */
+    mic_tcp_pdu syn;
+    preparer_controle(c, &syn, 1, 0, 0);
+    syn.payload.data=(char*)proposition;
+    syn.payload.size=sizeof(proposition);
+
+    mic_tcp_pdu syn_ack;
+    syn_ack.payload.data=accepte;
+
+    c->sock.state=SYN_SENT;
+    for (int essai=0; essai<MAX_ESSAIS_CONNEXION; essai++){
+        unsigned long date_envoi=get_now_time_usec();
+        if (IP_send(syn, c->distant)==-1){
+            LOG_ERROR("Erreur d'envoi du SYN");
+            break;
+        }
+        STATS_ADD(c->sock.fd, pdu_sent, 1);
+
+        syn_ack.payload.size=sizeof(accepte);
+        if (IP_recv_us(&syn_ack, NULL, rto_get(&c->rto))==-1){
+            LOG_DEBUG("Timer expiré : renvoi du SYN");
+            rto_backoff(&c->rto);
+            stats_rto(c->sock.fd, &c->rto);
+            STATS_ADD(c->sock.fd, timeouts, 1);
+            continue;
+        }
+        STATS_ADD(c->sock.fd, pdu_received, 1);
+        if (!syn_ack.header.syn || !syn_ack.header.ack || syn_ack.payload.size<1) continue;
+        if (syn_ack.header.dest_port!=c->sock.addr.port) continue; // Réponse destinée à un autre socket
+
+        rto_ack(&c->rto, get_now_time_usec()-date_envoi, essai>0);
+        stats_rto(c->sock.fd, &c->rto);
+        c->tolerance=(unsigned char)accepte[0]; // Le serveur a pu diminuer notre proposition
+        if (syn_ack.payload.size<2 || !accepte[1]) c->sack=0;
+        c->limite_env=syn_ack.header.window;
+
+        /* ACK final : s'il est perdu, le premier message établira la connexion */
+        mic_tcp_pdu ack;
+        preparer_controle(c, &ack, 0, 1, 0);
+        if (IP_send(ack, c->distant)!=-1){
+            STATS_ADD(c->sock.fd, pdu_sent, 1);
+            STATS_ADD(c->sock.fd, acks_sent, 1);
+        }
+
+        c->sock.state=ESTABLISHED;
+        loss_budget_init(&c->pertes, c->tolerance, FENETRE_PERTES);
+        LOG_INFO("Connexion établie, pertes tolérées : %d%%", c->tolerance);
+        return 0;
+    }
+
+    demux_remove(c->distant, c->sock.addr.port);
+    c->distant.ip_addr=NULL;
+    c->sock.state=CLOSED;
+    return -1;
+}
+
+/*
+ * Permet de réclamer l’envoi d’une donnée applicative
+ * Le message est placé dans la fenêtre d'émission puis envoyé ; la fonction ne
+ * bloque que si la fenêtre d'émission ou de congestion est pleine, ou si le récepteur n'a plus de place.
+ * Retourne la taille des données envoyées, et -1 en cas d'erreur
+ */
+static int v4_send(int mic_sock, char* mesg, int mesg_size)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* c=trouver(mic_sock);
+    if (c==NULL) return -1;
+
+    // Vérifier qu'on est connecté
+    if (c->sock.state!=ESTABLISHED) LOG_ERROR("Erreur : Connection non établie");
+
+    if (mesg_size>MAX_DATA_SIZE){
+        LOG_ERROR("Erreur : message trop long");
+        return -1;
+    }
+    if (mesg_size<=0) return 0; // Un PDU de données vide est une sonde de fenêtre
+    unsigned int soumission=get_now_time_usec(); // Attente d'une place dans la fenêtre comprise
+
+    /* Lecture des acks déjà arrivés et renvoi des PDU expirés */
+    recevoir_acks(0);
+    pthread_mutex_lock(&c->verrou_envoi);
+    long attente=renvoyer_expires(c, 0);
+
+    /* Attente d'une place libre dans la fenêtre et chez le récepteur */
+    while (!envoi_possible(c)){
+        sonder(c);
+        pthread_mutex_unlock(&c->verrou_envoi);
+        recevoir_acks(attente);
+        pthread_mutex_lock(&c->verrou_envoi);
+        attente=renvoyer_expires(c, 0);
+    }
+
+    /* Encapsulation du message dans la fenêtre */
+    segment* seg=&c->fenetre_env[c->num_sequence%WINDOW_SIZE];
+    seg->seq_num=c->num_sequence;
+    memcpy(seg->data, mesg, mesg_size);
+    seg->size=mesg_size;
+    seg->horodatage=soumission;
+    seg->essais=0;
+    seg->occupe=1;
+    c->num_sequence++;
+    c->en_vol++;
+
+    int sent_size=envoyer_segment(c, seg);
+    if (sent_size==-1){
+        LOG_ERROR("Erreur d'envoi");
+        exit(1);
+    }
+    pthread_mutex_unlock(&c->verrou_envoi);
+
+    return sent_size;
+}
+
+/*
+ * Permet à l’application réceptrice de réclamer la récupération d’une donnée
+ * stockée dans les buffers de réception du socket
+ * Retourne le nombre d’octets lu ou bien -1 en cas d’erreur
+ * NB : cette fonction fait appel à la fonction app_buffer_get()
+ */
+static int v4_recv(int socket, char* mesg, int max_mesg_size)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* c=trouver(socket);
+    if (c==NULL) return -1;
+
+    // Lire le socket
+    mic_tcp_payload payload;
+    payload.data = mesg;
+    payload.size = max_mesg_size;
+    int read_size = app_buffer_get(socket, payload);
+
+    // Une place vient de se libérer : messages gardés faute de place dans le buffer
+    pthread_mutex_lock(&verrou_connexion);
+    delivrer(c);
+    if (app_buffer_free(socket)>0 && __atomic_exchange_n(&c->fenetre_nulle, 0, __ATOMIC_SEQ_CST)){
+        // Le correspondant attend la réouverture de la fenêtre : on la lui annonce sans attendre sa sonde
+        annoncer_fenetre(c);
+    }
+    pthread_mutex_unlock(&verrou_connexion);
+
+    return read_size;
+}
+
+/*
+ * Permet de réclamer la destruction d’un socket.
+ * Attend que tous les PDU de la fenêtre d'émission soient acquittés.
+ * Retourne 0 si tout se passe bien et -1 en cas d'erreur
+ */
+static int v4_close(int socket)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    connexion* c=trouver(socket);
+    if (c==NULL) return -1;
+
+    pthread_mutex_lock(&c->verrou_envoi);
+    long attente=renvoyer_expires(c, MAX_ESSAIS);
+    while (attente!=-1 && c->base_env<c->num_sequence){
+        pthread_mutex_unlock(&c->verrou_envoi);
+        recevoir_acks(attente);
+        pthread_mutex_lock(&c->verrou_envoi);
+        attente=renvoyer_expires(c, MAX_ESSAIS);
+    }
+    int result=(c->base_env==c->num_sequence) ? 0 : -1;
+
+    c->sock.state=CLOSED;
+    pthread_mutex_unlock(&c->verrou_envoi);
+    detruire_connexion(c);
+    return result;
+}
+
+/*
+ * Permet de consulter le timer de retransmission courant du socket
+ * Retourne sa valeur en µs
+ */
+static unsigned long v4_get_rto(int socket)
+{
+    connexion* c=trouver(socket);
+    return (c!=NULL) ? rto_get(&c->rto) : 0;
+}
+
+/*
+ * Permet de choisir le % de pertes admissibles avant l'établissement de la connexion :
+ * proposé par le client dans mic_tcp_connect, maximum accepté par le serveur
+ * (hérité par les connexions créées ensuite sur le socket en écoute)
+ * Retourne 0 si succès, -1 en cas d'erreur
+ */
+static int v4_set_loss_tolerance(int socket, unsigned short percent)
+{
+    connexion* c=trouver(socket);
+    if (c==NULL || percent>100 || c->sock.state!=IDLE) return -1;
+    c->tolerance=percent;
+    return 0;
+}
+
+/*
+ * Permet de choisir le délai maximal d'acquittement d'un PDU reçu dans l'ordre, 0 pour acquitter
+ * chaque PDU aussitôt (hérité par les connexions créées ensuite sur un socket en écoute).
+ * Le délai doit rester sous RTO_MIN, sans quoi l'émetteur renverrait les PDU dont l'ack attend.
+ * Retourne 0 si succès, -1 en cas d'erreur
+ */
+static int v4_set_ack_delay(int socket, unsigned long delay_usec)
+{
+    connexion* c=trouver(socket);
+    if (c==NULL || delay_usec>=RTO_MIN) return -1;
+
+    pthread_mutex_lock(&verrou_connexion);
+    c->delai_ack=delay_usec;
+    pthread_mutex_unlock(&verrou_connexion);
+    return 0;
+}
+
+/*
+ * Traitement d’un PDU MIC-TCP reçu (mise à jour des numéros de séquence
+ * et d'acquittement, etc.) puis insère les données utiles du PDU dans
+ * le buffer de réception du socket. Cette fonction utilise la fonction
+ * app_buffer_put().
+ */
+static void v4_process_received_PDU(mic_tcp_pdu pdu, mic_tcp_sock_addr addr, int socket)
+{
+    LOG_TRACE("[MIC-TCP] Appel de la fonction: %s", __FUNCTION__);
+
+    pthread_mutex_lock(&verrou_connexion);
+
+    connexion* c=trouver(socket);
+    if (c==NULL){ // Aucun socket pour ce PDU
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+    STATS_ADD(socket, pdu_received, 1);
+
+    /* Etablissement de la connexion */
+    if (c->ecoute){
+        if (pdu.header.syn) nouvelle_connexion(c, pdu, addr);
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+    if (pdu.header.syn){
+        repondre_syn(c, pdu);
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+    if (pdu.header.ack){
+        if (c->sock.state==SYN_RECEIVED){ // ACK final de la poignée de main
+            c->limite_env=pdu.header.window;
+            connexion_etablie(c);
+        }
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+    if (c->sock.state==SYN_RECEIVED) connexion_etablie(c); // ACK final perdu : le message vaut confirmation
+    if (c->sock.state!=ESTABLISHED){ // Pas de connexion : le message est ignoré
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+
+    if (pdu.payload.size==0){ // Sonde de fenêtre nulle : on répond par notre fenêtre
+        annoncer_fenetre(c);
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+
+    unsigned int num=pdu.header.seq_num;
+    unsigned int attendu=c->base_rec;
+
+    // Pertes tolérées : l'émetteur a abandonné les PDU précédant ack_num, on saute ceux qui manquent
+    while (c->tolerance>0 && c->base_rec<pdu.header.ack_num && c->base_rec<=num){
+        segment* seg=&c->fenetre_rec[c->base_rec%WINDOW_SIZE];
+        if (seg->occupe){
+            mic_tcp_payload payload;
+            payload.data=seg->data;
+            payload.size=seg->size;
+            if (app_buffer_put(socket, payload, seg->horodatage)==-1) break; // Buffer plein : on reprendra plus tard
+            STATS_ADD(socket, bytes_delivered, seg->size);
+            seg->occupe=0;
+        } else {
+            STATS_ADD(socket, holes_skipped, 1);
+        }
+        c->base_rec++;
+    }
+
+    // Hors fenêtre (en avance) : on ignore, l'émetteur ne peut pas l'avoir envoyé
+    if (num>=c->base_rec+WINDOW_SIZE){
+        pthread_mutex_unlock(&verrou_connexion);
+        return;
+    }
+
+    // Dans la fenêtre et pas encore reçu : on le garde
+    if (num>=c->base_rec){
+        segment* seg=&c->fenetre_rec[num%WINDOW_SIZE];
+        if (!seg->occupe){
+            seg->seq_num=num;
+            memcpy(seg->data, pdu.payload.data, pdu.payload.size);
+            seg->size=pdu.payload.size;
+            seg->horodatage=pdu.header.timestamp;
+            seg->occupe=1;
+            if (num>c->base_rec) STATS_ADD(socket, reordered, 1);
+        } else {
+            STATS_ADD(socket, duplicates, 1);
+        }
+    } else { // Déjà délivré : on renvoie simplement l'ack (perte d'ack)
+        STATS_ADD(socket, duplicates, 1);
+    }
+
+    delivrer(c);
+
+    /* Le PDU attendu, délivré sans combler de trou ni remplir le buffer : son ack peut attendre le suivant */
+    if (c->delai_ack>0 && num==attendu && c->base_rec==num+1 && !en_attente(c) && app_buffer_free(socket)>0){
+        c->num_retarde=num;
+        if (++c->acks_retardes<ACKS_CUMULES){
+            if (c->acks_retardes==1){
+                c->echeance_ack=get_now_time_usec()+c->delai_ack;
+                timer_arm(socket, c->delai_ack, ack_retarde);
+            }
+            pthread_mutex_unlock(&verrou_connexion);
+            return;
+        }
+    }
+
+    envoyer_ack(c, num);
+
+    pthread_mutex_unlock(&verrou_connexion);
+}
+
+/*
+ * Fonctions de cette version, appelées par l'interface (src/mictcp.c)
+ */
+const mic_tcp_policy mictcp_v4={
+    .name="v4",
+    .socket=v4_socket,
+    .bind=v4_bind,
+    .accept=v4_accept,
+    .connect=v4_connect,
+    .send=v4_send,
+    .recv=v4_recv,
+    .close=v4_close,
+    .get_rto=v4_get_rto,
+    .set_loss_tolerance=v4_set_loss_tolerance,
+    .set_ack_delay=v4_set_ack_delay,
+    .process_received_PDU=v4_process_received_PDU
+};